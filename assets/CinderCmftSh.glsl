@@ -0,0 +1,20 @@
+// L2 spherical harmonics irradiance evaluation matching cmft::createIemSh
+// Upload the coefficients with prog->uniform( "uShCoeffs", coeffs.data(), 9 )
+// and include this snippet before using shIrradiance( N ).
+
+uniform vec3 uShCoeffs[9];
+
+// returns the diffuse irradiance ( divided by pi ) in direction n, same as sampling an iem cubemap
+vec3 shIrradiance( vec3 n )
+{
+	vec3 result	= uShCoeffs[0] * 0.282095;
+	result		+= uShCoeffs[1] * -0.488603 * n.y;
+	result		+= uShCoeffs[2] * 0.488603 * n.z;
+	result		+= uShCoeffs[3] * -0.488603 * n.x;
+	result		+= uShCoeffs[4] * 1.092548 * n.x * n.y;
+	result		+= uShCoeffs[5] * -1.092548 * n.y * n.z;
+	result		+= uShCoeffs[6] * 0.315392 * ( 3.0 * n.z * n.z - 1.0 );
+	result		+= uShCoeffs[7] * -1.092548 * n.x * n.z;
+	result		+= uShCoeffs[8] * 0.546274 * ( n.x * n.x - n.y * n.y );
+	return max( result, vec3( 0.0 ) );
+}
@@ -0,0 +1,35 @@
+if( NOT TARGET Cinder-Cmft )
+	get_filename_component( CINDER_CMFT_PATH "${CMAKE_CURRENT_LIST_DIR}/../.." ABSOLUTE )
+	get_filename_component( CINDER_PATH "${CMAKE_CURRENT_LIST_DIR}/../../../.." ABSOLUTE )
+
+	file( GLOB CINDER_CMFT_SOURCES
+		${CINDER_CMFT_PATH}/src/*.cpp
+		${CINDER_CMFT_PATH}/lib/cmft/src/cmft/*.cpp
+		${CINDER_CMFT_PATH}/lib/cmft/src/cmft/base/*.cpp
+	)
+
+	add_library( Cinder-Cmft ${CINDER_CMFT_SOURCES} )
+
+	target_include_directories( Cinder-Cmft PUBLIC
+		${CINDER_CMFT_PATH}/src
+		${CINDER_CMFT_PATH}/lib/cmft/include
+		${CINDER_CMFT_PATH}/lib/cmft/dependency/bx/include
+		${CINDER_CMFT_PATH}/lib/cmft/dependency/dm/include
+		${CINDER_CMFT_PATH}/lib/opencl/include
+		${CINDER_CMFT_PATH}/lib/cmft/src/cmft
+	)
+	target_include_directories( Cinder-Cmft SYSTEM BEFORE PUBLIC "${CINDER_PATH}/include" )
+
+	if( NOT TARGET cinder )
+		include( "${CINDER_PATH}/proj/cmake/configure.cmake" )
+		find_package( cinder REQUIRED PATHS
+			"${CINDER_PATH}/${CINDER_LIB_DIRECTORY}"
+			"$ENV{CINDER_PATH}/${CINDER_LIB_DIRECTORY}" )
+	endif()
+
+	# cmft loads the OpenCL runtime dynamically, machines without it fall back to the cpu backends
+	target_link_libraries( Cinder-Cmft PRIVATE cinder )
+	if( CINDER_LINUX )
+		target_link_libraries( Cinder-Cmft PUBLIC dl pthread )
+	endif()
+endif()
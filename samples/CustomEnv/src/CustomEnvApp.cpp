@@ -6,6 +6,7 @@
 
 #include "CinderImGui.h"
 #include "CinderCmft.h"
+#include "CinderCmftImGui.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -19,10 +20,13 @@ class CustomEnvApp : public App {
 
 	void createEnvironment();
 	void updateEnvironmentMaps();
+	void updatePendingMaps();
 
 	gl::BatchRef			mModel, mSkyBox, mCornelBox;
 	gl::TextureCubeMapRef	mPmrem, mIem, mEm;
 	gl::FboCubeMapRef		mEmFbo;
+	cmft::CubemapReadbackRef	mEmReadback;
+	cmft::AsyncTextureCubeMapRef mPendingPmrem, mPendingIem;
 	gl::Texture2dRef		mCornelBoxLightMap;
 	
 	ci::CameraPersp			mCamera;
@@ -30,7 +34,7 @@ class CustomEnvApp : public App {
 
 	float					mExposure, mWhiteLevel, mRoughness, mMetallic;
 	
-	bool					mUseCornelBox;
+	bool					mUseCornelBox, mShowPerformance;
 	Color					mCeilingLightColor, mFrontLightColor;
 	float					mCornelBoxExposure, mCeilingLightStrength, mCeilingLightWidth, mFrontLightStrength, mFrontLightWidth;
 };
@@ -47,6 +51,7 @@ mFrontLightColor( Color( 1.0f, 0.3f, 0.26f ) ),
 mFrontLightStrength( 1.0f ),
 mFrontLightWidth( 2.0f ),
 mUseCornelBox( false ),
+mShowPerformance( true ),
 mCornelBoxExposure( 0.65f )
 {
 	// setup ui
@@ -78,7 +83,13 @@ mCornelBoxExposure( 0.65f )
 	auto fboFormat = gl::FboCubeMap::Format().textureCubeMapFormat( gl::TextureCubeMap::Format().internalFormat( GL_RGBA32F ) );
 	mEmFbo = gl::FboCubeMap::create( 1024, 1024, fboFormat );
 	createEnvironment();
-	updateEnvironmentMaps();
+
+	// the first maps are created synchronously
+	cmft::Image input;
+	cmft::textureCubemapToImage( mEm, input );
+	mPmrem = cmft::createPmrem( input, 256, cmft::RadianceFilterOptions().gammaCorrection( 1, 1 ) );
+	mIem = cmft::createIem( input, 64, cmft::IrradianceFilterOptions().gammaCorrection( 1,1 ) );
+	cmft::imageUnload( input );
 }
 
 void CustomEnvApp::createEnvironment()
@@ -117,16 +128,36 @@ void CustomEnvApp::createEnvironment()
 }
 void CustomEnvApp::updateEnvironmentMaps()
 {
+	// read the environment back without stalling, at half precision to save bandwidth
+	mEmReadback = cmft::CubemapReadback::create( mEm, cmft::TextureFormat::RGBA16F );
+}
+void CustomEnvApp::updatePendingMaps()
+{
+	// once the gpu is done with the copy, filter the maps on worker threads
 	cmft::Image input;
-	cmft::textureCubemapToImage( mEm, input );
-	mPmrem = cmft::createPmrem( input, 256, cmft::RadianceFilterOptions().gammaCorrection( 1, 1 ) );
-	mIem = cmft::createIem( input, 64, cmft::IrradianceFilterOptions().gammaCorrection( 1,1 ) );
-	cmft::imageUnload( input );
+	if( mEmReadback && mEmReadback->getImage( input ) ) {
+		mPendingPmrem = cmft::createPmremAsync( input, 256, cmft::RadianceFilterOptions().gammaCorrection( 1, 1 ) );
+		mPendingIem = cmft::createIemAsync( input, 64, cmft::IrradianceFilterOptions().gammaCorrection( 1,1 ) );
+		cmft::imageUnload( input );
+		mEmReadback.reset();
+	}
+
+	// and swap them when they are ready
+	if( mPendingPmrem && mPendingPmrem->isReady() && mPendingIem->isReady() ) {
+		if( mPendingPmrem->succeeded() && mPendingIem->succeeded() ) {
+			mPmrem = mPendingPmrem->getTexture();
+			mIem = mPendingIem->getTexture();
+		}
+		mPendingPmrem.reset();
+		mPendingIem.reset();
+	}
 }
 
 
 void CustomEnvApp::update()
 {
+	updatePendingMaps();
+
 	// user interface
 	{
 		ui::ScopedWindow scopedWindow( "Options" );
@@ -163,6 +194,12 @@ void CustomEnvApp::update()
 		if( ui::Button( "Update Maps" ) ) {
 			updateEnvironmentMaps();
 		}
+		ui::Checkbox( "Show Performance", &mShowPerformance );
+	}
+
+	// bake timings, cache state and cubemaps memory
+	if( mShowPerformance ) {
+		cmft::drawPerformancePanel();
 	}
 }
 
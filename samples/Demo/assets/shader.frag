@@ -1,11 +1,5 @@
 #version 150
 
-// Basic fresnel function
-vec3 fresnel( vec3 reflectivity, float NoV, float strength )
-{
-    return reflectivity + ( 1.0 - reflectivity ) * pow( 1.0 - NoV, 5.0 ) * strength;
-}
-
 // ShaderX5: Normal Mapping without Precomputed Tangents
 // http://www.slideshare.net/KyuseokHwang/shaderx5-26normalmappingwithoutprecomputedtangents-130318-1
 // http://www.thetenthplanet.de/archives/1180
@@ -45,6 +39,7 @@ vec3 Uncharted2Tonemap( vec3 x )
 
 uniform samplerCube uPmremSampler;
 uniform samplerCube uIemSampler;
+uniform sampler2D 	uBrdfLutSampler;
 
 uniform sampler2D 	uRoughnessSampler;
 uniform sampler2D 	uMetallicSampler;
@@ -81,10 +76,11 @@ void main( void )
     float NoV 				= clamp( dot( N, V ), 0.0, 1.0 );
 
     // sample the environment maps
+	// the radiance filter and the brdf lut both map the roughness linearly to mip / ( mipCount - 1 )
 	const float mipCount 	= 7.0;
-	float mip 				= mipCount - 1.0 - ( 1.0 - log2( roughness ) );
-	vec3 fresnel 			= fresnel( specularColor, NoV, 1.0 - ( roughness * roughness ) );
-	vec3 radiance   		= fresnel * textureLod( uPmremSampler, R, mip ).xyz;
+	float mip 				= roughness * ( mipCount - 1.0 );
+	vec2 brdf 				= texture( uBrdfLutSampler, vec2( NoV, mip / ( mipCount - 1.0 ) ) ).rg;
+	vec3 radiance   		= ( specularColor * brdf.x + brdf.y ) * textureLod( uPmremSampler, R, mip ).xyz;
 	vec3 irradiance 		= diffuseColor * texture( uIemSampler, vNormal ).xyz;
 	vec3 color 				= irradiance + radiance;
 
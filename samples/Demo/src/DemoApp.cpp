@@ -5,6 +5,7 @@
 
 #include "CinderImGui.h"
 #include "CinderCmft.h"
+#include "CinderCmftImGui.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -17,21 +18,23 @@ class DemoApp : public App {
 
 	gl::BatchRef			mModel, mSkyBox;
 	gl::TextureCubeMapRef	mPmrem, mIem, mEm;
-	gl::Texture2dRef		mRoughness, mMetallic, mNormal, mBaseColor;
+	cmft::AsyncEnvironmentSet mPendingEnv;
+	gl::Texture2dRef		mRoughness, mMetallic, mNormal, mBaseColor, mBrdfLut;
 	
 	ci::CameraPersp			mCamera;
 	ci::CameraUi			mCameraUi;
 
 	int						mCurrentEnv;
 	float					mExposure, mWhiteLevel;
-	bool					mShowOriginal;
+	bool					mShowOriginal, mShowPerformance;
 };
 
 DemoApp::DemoApp()
 : mCurrentEnv( 0 ),
 mExposure( 1.0f ),
 mWhiteLevel( 0.6f ),
-mShowOriginal( true )
+mShowOriginal( true ),
+mShowPerformance( true )
 {
 	// setup ui
 	ui::initialize();
@@ -54,13 +57,15 @@ mShowOriginal( true )
 	cmft::connectConsole( true, true );
 
 	// create the skybox, radiance and irradiance environment map
-	// this will by default cache env_pmrem.dds and env_iem.dds for
+	// this will by default cache env_pmrem_<key>.dds and env_iem_<key>.dds for
 	// a much faster initialization on the next run
-	auto imgPath	= getAssetPath( "04-12_Sun_A.hdr" );
-	mEm				= cmft::createTextureCubemap( imgPath );
-	mPmrem			= cmft::createPmrem( imgPath, 256 );
-	mIem			= cmft::createIem( imgPath, 64 );
-	
+	auto env		= cmft::createEnvironmentSet( getAssetPath( "04-12_Sun_A.hdr" ), cmft::EnvironmentOptions().pmrem( 256 ).iem( 64 ) );
+	mEm				= env.mEm;
+	mPmrem			= env.mPmrem;
+	mIem			= env.mIem;
+
+	// and the brdf lookup table matching the radiance filter options
+	mBrdfLut		= cmft::createBrdfLut( 128 );
 
 	// load material textures
 	auto texFormat	= gl::Texture2d::Format().mipmap().minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR );
@@ -78,13 +83,30 @@ void DemoApp::draw()
 		ui::Checkbox( "Show Original", &mShowOriginal );
 		static vector<string> hdrs = { "04-12_Sun_A.hdr", "02-04_Garage.hdr", "08-21_Swiss_B.hdr", "05-20_Park_B.hdr", "08-07_Night_B.hdr", "08-08_Sunset_B.hdr" };
 		if( ui::Combo( "Environment", &mCurrentEnv, hdrs ) ) {
-			auto imgPath	= getAssetPath( hdrs[mCurrentEnv] );
-			mEm				= cmft::createTextureCubemap( imgPath );
-			mPmrem			= cmft::createPmrem( imgPath, 256 );
-			mIem			= cmft::createIem( imgPath, 64 );
+			// load and filter the new environment in the background
+			mPendingEnv		= cmft::createEnvironmentSetAsync( getAssetPath( hdrs[mCurrentEnv] ), cmft::EnvironmentOptions().pmrem( 256 ).iem( 64 ) );
+		}
+		if( mPendingEnv.mEm ) {
+			ui::Text( "Loading..." );
 		}
 		ui::DragFloat( "Exposure", &mExposure, 0.01f, 0.001f, 20.0f );
 		ui::DragFloat( "White Level", &mWhiteLevel, 0.01f, 0.001f, 20.0f );
+		ui::Checkbox( "Show Performance", &mShowPerformance );
+	}
+
+	// bake timings, cache state and cubemaps memory
+	if( mShowPerformance ) {
+		cmft::drawPerformancePanel();
+	}
+
+	// swap the environment maps once the background bake is done
+	if( mPendingEnv.mEm && mPendingEnv.mEm->isReady() ) {
+		if( mPendingEnv.mEm->succeeded() ) {
+			mEm		= mPendingEnv.mEm->getTexture();
+			mPmrem	= mPendingEnv.mPmrem->getTexture();
+			mIem	= mPendingEnv.mIem->getTexture();
+		}
+		mPendingEnv = cmft::AsyncEnvironmentSet();
 	}
 
 	// clear buffers
@@ -104,6 +126,7 @@ void DemoApp::draw()
 	gl::ScopedTextureBind scopedTex4( mMetallic, 4 );
 	gl::ScopedTextureBind scopedTex5( mNormal, 5 );
 	gl::ScopedTextureBind scopedTex6( mBaseColor, 6 );
+	gl::ScopedTextureBind scopedTex7( mBrdfLut, 7 );
 	
 
 	// render the test model
@@ -114,6 +137,7 @@ void DemoApp::draw()
 		mModel->getGlslProg()->uniform( "uMetallicSampler", 4 );
 		mModel->getGlslProg()->uniform( "uNormalSampler", 5 );
 		mModel->getGlslProg()->uniform( "uBaseColorSampler", 6 );
+		mModel->getGlslProg()->uniform( "uBrdfLutSampler", 7 );
 		mModel->getGlslProg()->uniform( "uExposure", mExposure );
 		mModel->getGlslProg()->uniform( "uWhiteLevel", mWhiteLevel );
 		mModel->getGlslProg()->uniform( "uCameraPos", mCamera.getEyePoint() );
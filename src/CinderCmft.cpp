@@ -1,493 +1,2543 @@
 #include "CinderCmft.h"
+#include "CinderCmftKernels.h"
 #include "cinder/app/App.h"
 #include "cinder/gl/scoped.h"
+#include "cinder/gl/wrapper.h"
+#include "cinder/gl/Pbo.h"
+#include "cinder/Log.h"
 #include "cmft/clcontext.h"
 #include "cmft/print.h"
+#include "glm/gtc/packing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#if defined( CINDER_MSW )
+	#if ! defined( NOMINMAX )
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
 
 using namespace ci;
 using namespace std;
 
 namespace cmft {
 
+namespace {
+	// process-wide counters, only ever updated with atomic operations
+	struct MetricsCounters {
+		std::atomic<uint64_t>	mCacheHits, mCacheMisses, mBytesRead, mBytesWritten, mBakes;
+		std::atomic<uint64_t>	mFilterCounts[ComputeBackend::Count], mFilterNanoseconds[ComputeBackend::Count];
+		std::atomic<uint64_t>	mLiveImages, mLiveImageBytes, mPeakImageBytes, mClContextCreations;
+	};
+
+	MetricsCounters& getMetricsCounters()
+	{
+		// zero initialized as a static
+		static MetricsCounters counters;
+		return counters;
+	}
+
+	void addLiveImage( uint64_t bytes )
+	{
+		auto &counters = getMetricsCounters();
+		++counters.mLiveImages;
+		uint64_t liveBytes = counters.mLiveImageBytes += bytes;
+		uint64_t peakBytes = counters.mPeakImageBytes.load();
+		while( liveBytes > peakBytes && ! counters.mPeakImageBytes.compare_exchange_weak( peakBytes, liveBytes ) ) {}
+	}
+
+	void removeLiveImage( uint64_t bytes )
+	{
+		auto &counters = getMetricsCounters();
+		--counters.mLiveImages;
+		counters.mLiveImageBytes -= bytes;
+	}
+
+	void recordBytesRead( const ci::fs::path &path )
+	{
+		// ci::fs is boost::filesystem on some platforms, whose error_code overloads take a boost::system::error_code
+		try {
+			getMetricsCounters().mBytesRead += fs::file_size( path );
+		}
+		catch( const std::exception & ) {
+		}
+	}
+
+	void recordBytesWritten( const ci::fs::path &path )
+	{
+		try {
+			getMetricsCounters().mBytesWritten += fs::file_size( path );
+		}
+		catch( const std::exception & ) {
+		}
+	}
+
+	struct BakeStatsRegistry {
+		std::mutex								mMutex;
+		// stats of the last create call completed on each thread
+		std::map<std::thread::id, BakeStats>	mLast;
+		// stats of the last create calls completed on any thread, most recent first
+		std::deque<BakeStats>					mRecent;
+		std::function<void( const BakeStats& )> mCallback;
+	};
+
+	BakeStatsRegistry& getBakeStatsRegistry()
+	{
+		static BakeStatsRegistry registry;
+		return registry;
+	}
+
+	const size_t sMaxRecentBakeStats = 32;
+
+	class BakeStatsScope;
+	// outermost create call running on this thread, if any
+	CMFT_THREAD_LOCAL BakeStatsScope *sActiveScope = nullptr;
+
+	// collects the stats of a public create call. Only the outermost scope of a thread collects and reports them
+	class BakeStatsScope {
+	public:
+		BakeStatsScope( const char *function, const ci::fs::path &source = ci::fs::path() )
+			: mTrace( function ), mStart( chrono::steady_clock::now() ), mOwner( ! sActiveScope )
+		{
+			if( mOwner ) {
+				mStats.mFunction = function;
+				mStats.mSource = source;
+				sActiveScope = this;
+				++getMetricsCounters().mBakes;
+			}
+		}
+		~BakeStatsScope()
+		{
+			if( ! mOwner ) {
+				return;
+			}
+			sActiveScope = nullptr;
+			mStats.mTotalTime = chrono::duration<double>( chrono::steady_clock::now() - mStart ).count();
+
+			// whatever image is left is returned to the caller
+			for( const auto &image : mImages ) {
+				removeLiveImage( image.second );
+			}
+
+			std::function<void( const BakeStats& )> callback;
+			{
+				auto &registry = getBakeStatsRegistry();
+				lock_guard<mutex> lock( registry.mMutex );
+				registry.mLast[this_thread::get_id()] = mStats;
+				registry.mRecent.push_front( mStats );
+				if( registry.mRecent.size() > sMaxRecentBakeStats ) {
+					registry.mRecent.pop_back();
+				}
+				callback = registry.mCallback;
+			}
+			if( callback ) {
+				callback( mStats );
+			}
+		}
+
+		BakeStats& getStats() { return mStats; }
+
+		void trackImage( const cmft::Image &image )
+		{
+			mStats.mBytesAllocated += image.m_dataSize;
+			mImages.push_back( make_pair( image.m_data, static_cast<uint64_t>( image.m_dataSize ) ) );
+			addLiveImage( image.m_dataSize );
+		}
+		bool untrackImage( const cmft::Image &image )
+		{
+			auto it = find_if( mImages.begin(), mImages.end(), [&image]( const pair<void*, uint64_t> &tracked ) { return tracked.first == image.m_data; } );
+			if( it == mImages.end() ) {
+				return false;
+			}
+			removeLiveImage( it->second );
+			mImages.erase( it );
+			return true;
+		}
+
+	protected:
+		detail::TraceScope					mTrace;
+		BakeStats							mStats;
+		chrono::steady_clock::time_point	mStart;
+		bool								mOwner;
+		// image buffers allocated by the call and not released yet
+		std::vector<pair<void*, uint64_t>>	mImages;
+	};
+
+	// returns the stats of the create call running on this thread, if any
+	BakeStats* getActiveBakeStats()
+	{
+		return sActiveScope ? &sActiveScope->getStats() : nullptr;
+	}
+
+	// adds the time until the end of the scope to \a stage of the running create call
+	class StageTimer {
+	public:
+		StageTimer( BakeStage::Enum stage ) : mTrace( getBakeStageName( stage ) ), mStats( getActiveBakeStats() ), mStage( stage ), mStart( chrono::steady_clock::now() ) {}
+		~StageTimer()
+		{
+			if( mStats ) {
+				mStats->mStageTimes[mStage] += chrono::duration<double>( chrono::steady_clock::now() - mStart ).count();
+			}
+		}
+
+	protected:
+		detail::TraceScope					mTrace;
+		BakeStats*							mStats;
+		BakeStage::Enum						mStage;
+		chrono::steady_clock::time_point	mStart;
+	};
+
+	// times a filter run, in the filter stage of the running create call and in the backend metrics
+	class FilterTimer : public StageTimer {
+	public:
+		FilterTimer( ComputeBackend::Enum backend, uint32_t numThreads ) : StageTimer( BakeStage::Filter ), mBackend( backend )
+		{
+			if( mStats ) {
+				mStats->mFiltered = true;
+				mStats->mBackend = backend;
+				mStats->mNumThreads = numThreads ? numThreads : glm::max( 1u, thread::hardware_concurrency() );
+			}
+		}
+		~FilterTimer()
+		{
+			auto &counters = getMetricsCounters();
+			++counters.mFilterCounts[mBackend];
+			counters.mFilterNanoseconds[mBackend] += chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now() - mStart ).count();
+		}
+
+	protected:
+		ComputeBackend::Enum mBackend;
+	};
+
+	// accounts a new image buffer to the running create call
+	void trackImage( const cmft::Image &image )
+	{
+		if( sActiveScope && cmft::imageIsValid( image ) ) {
+			sActiveScope->trackImage( image );
+		}
+	}
+	// stops accounting an image buffer about to be released or replaced, returns whether it was accounted
+	bool untrackImage( const cmft::Image &image )
+	{
+		return sActiveScope && image.m_data && sActiveScope->untrackImage( image );
+	}
+	// releases an image buffer
+	void unloadImage( cmft::Image &image )
+	{
+		if( cmft::imageIsValid( image ) ) {
+			untrackImage( image );
+			cmft::imageUnload( image );
+		}
+	}
+
+	void recordCacheLookup( bool hit )
+	{
+		++( hit ? getMetricsCounters().mCacheHits : getMetricsCounters().mCacheMisses );
+		if( auto stats = getActiveBakeStats() ) {
+			++( hit ? stats->mCacheHits : stats->mCacheMisses );
+		}
+	}
+}
+
+const char* getBakeStageName( BakeStage::Enum stage )
+{
+	static const char* names[BakeStage::Count] = { "load", "convert", "resize", "gamma", "filter", "brdf lut", "sh", "cache load", "cache save", "upload" };
+	return stage < BakeStage::Count ? names[stage] : "unknown";
+}
+
+BakeStats::BakeStats()
+: mTotalTime( 0.0 ), mBytesAllocated( 0 ), mCacheHits( 0 ), mCacheMisses( 0 ), mFiltered( false ), mBackend( ComputeBackend::Cpu ), mNumThreads( 0 )
+{
+	std::fill( mStageTimes, mStageTimes + BakeStage::Count, 0.0 );
+}
+
+double BakeStats::getStagesTime() const
+{
+	double time = 0.0;
+	for( auto stageTime : mStageTimes ) {
+		time += stageTime;
+	}
+	return time;
+}
+
+void setBakeStatsCallback( const std::function<void( const BakeStats& )> &callback )
+{
+	auto &registry = getBakeStatsRegistry();
+	lock_guard<mutex> lock( registry.mMutex );
+	registry.mCallback = callback;
+}
+
+BakeStats getLastBakeStats()
+{
+	auto &registry = getBakeStatsRegistry();
+	lock_guard<mutex> lock( registry.mMutex );
+	auto it = registry.mLast.find( this_thread::get_id() );
+	return it != registry.mLast.end() ? it->second : BakeStats();
+}
+
+std::vector<BakeStats> getRecentBakeStats()
+{
+	auto &registry = getBakeStatsRegistry();
+	lock_guard<mutex> lock( registry.mMutex );
+	return std::vector<BakeStats>( registry.mRecent.begin(), registry.mRecent.end() );
+}
+
+Metrics::Metrics()
+: mCacheHits( 0 ), mCacheMisses( 0 ), mBytesRead( 0 ), mBytesWritten( 0 ), mBakes( 0 ), mLiveImages( 0 ), mLiveImageBytes( 0 ), mPeakImageBytes( 0 ), mClContextCreations( 0 )
+{
+	std::fill( mFilterCounts, mFilterCounts + ComputeBackend::Count, 0 );
+	std::fill( mFilterTimes, mFilterTimes + ComputeBackend::Count, 0.0 );
+}
+
+Metrics getMetrics()
+{
+	auto &counters = getMetricsCounters();
+	Metrics metrics;
+	metrics.mCacheHits = counters.mCacheHits;
+	metrics.mCacheMisses = counters.mCacheMisses;
+	metrics.mBytesRead = counters.mBytesRead;
+	metrics.mBytesWritten = counters.mBytesWritten;
+	metrics.mBakes = counters.mBakes;
+	for( size_t i = 0; i < ComputeBackend::Count; ++i ) {
+		metrics.mFilterCounts[i] = counters.mFilterCounts[i];
+		metrics.mFilterTimes[i] = counters.mFilterNanoseconds[i] * 1e-9;
+	}
+	metrics.mLiveImages = counters.mLiveImages;
+	metrics.mLiveImageBytes = counters.mLiveImageBytes;
+	metrics.mPeakImageBytes = counters.mPeakImageBytes;
+	metrics.mClContextCreations = counters.mClContextCreations;
+	return metrics;
+}
+
+void resetMetrics()
+{
+	auto &counters = getMetricsCounters();
+	for( auto counter : { &counters.mCacheHits, &counters.mCacheMisses, &counters.mBytesRead, &counters.mBytesWritten, &counters.mBakes, &counters.mClContextCreations } ) {
+		*counter = 0;
+	}
+	for( size_t i = 0; i < ComputeBackend::Count; ++i ) {
+		counters.mFilterCounts[i] = 0;
+		counters.mFilterNanoseconds[i] = 0;
+	}
+	counters.mPeakImageBytes = counters.mLiveImageBytes.load();
+}
+
 void surfaceToImage( const ci::Surface &surface, cmft::Image &output )
 {	
-	if( cmft::imageIsValid( output ) ) {
-		cmft::imageUnload( output );
-	}
+	StageTimer timer( BakeStage::Convert );
+	unloadImage( output );
 	cmft::imageCreate( output, surface.getWidth(), surface.getHeight(), 0x000000ff, 1, 1, surface.hasAlpha() ? cmft::TextureFormat::RGBA8 : cmft::TextureFormat::RGB8 );
 	memcpy( output.m_data, (void*) surface.getData(), output.m_dataSize );
+	trackImage( output );
 }
-void textureCubemapToImage( const ci::gl::TextureCubeMapRef &cubemap, cmft::Image &output )
-{
-	GLenum format, dataType;
-	cmft::TextureFormat::Enum texFormat = cmft::TextureFormat::RGBA32F;
-	switch( cubemap->getInternalFormat() ) {
-	case GL_BGR:
-		format = GL_BGR;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat = cmft::TextureFormat::BGR8;
-		break;
-	case GL_RGB8:
-		format = GL_RGB;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat = cmft::TextureFormat::RGB8;
-		break;
-	case GL_RGB16:
-		format = GL_RGB;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat = cmft::TextureFormat::RGB16;
-		break;
-	case GL_RGB16F:
-		format = GL_RGB;
-		dataType = GL_HALF_FLOAT;
+namespace {
+	// opengl formats matching a cmft::TextureFormat
+	bool getGlPixelFormat( cmft::TextureFormat::Enum imageFormat, GLint &internalFormat, GLenum &format, GLenum &dataType )
+	{
+		switch( imageFormat ) {
+		case cmft::TextureFormat::BGR8:
+			format = GL_BGR;
+			dataType = GL_UNSIGNED_BYTE;
+			internalFormat = GL_BGR;
+			return true;
+		case cmft::TextureFormat::RGB8:
+			format = GL_RGB;
+			dataType = GL_UNSIGNED_BYTE;
+			internalFormat = GL_RGB8;
+			return true;
+		case cmft::TextureFormat::RGB16:
+			format = GL_RGB;
+			dataType = GL_UNSIGNED_SHORT;
+			internalFormat = GL_RGB16;
+			return true;
+		case cmft::TextureFormat::RGB16F:
+			format = GL_RGB;
+			dataType = GL_HALF_FLOAT;
+			internalFormat = GL_RGB16F;
+			return true;
+		case cmft::TextureFormat::RGB32F:
+			format = GL_RGB;
+			dataType = GL_FLOAT;
+			internalFormat = GL_RGB32F;
+			return true;
+		case cmft::TextureFormat::BGRA8:
+			format = GL_BGRA;
+			dataType = GL_UNSIGNED_BYTE;
+			internalFormat = GL_BGRA;
+			return true;
+		case cmft::TextureFormat::RGBA8:
+			format = GL_RGBA;
+			dataType = GL_UNSIGNED_BYTE;
+			internalFormat = GL_RGBA8;
+			return true;
+		case cmft::TextureFormat::RGBA16:
+			format = GL_RGBA;
+			dataType = GL_UNSIGNED_SHORT;
+			internalFormat = GL_RGBA16;
+			return true;
+		case cmft::TextureFormat::RGBA16F:
+			format = GL_RGBA;
+			dataType = GL_HALF_FLOAT;
+			internalFormat = GL_RGBA16F;
+			return true;
+		case cmft::TextureFormat::RGBA32F:
+			format = GL_RGBA;
+			dataType = GL_FLOAT;
+			internalFormat = GL_RGBA32F;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// cmft::TextureFormat matching an opengl internal format
+	cmft::TextureFormat::Enum getImageFormat( GLint internalFormat )
+	{
+		switch( internalFormat ) {
+		case GL_BGR:		return cmft::TextureFormat::BGR8;
+		case GL_RGB8:		return cmft::TextureFormat::RGB8;
+		case GL_RGB16:		return cmft::TextureFormat::RGB16;
 		// forcing alpha channel. see https://github.com/dariomanesku/cmft/issues/21
-		texFormat = TextureFormat::RGBA16F;
-			// cmft::TextureFormat::RGB16F;
-		break;
-	case GL_RGB32F:
-		format = GL_RGB;
-		dataType = GL_FLOAT;
-		texFormat = cmft::TextureFormat::RGB32F;
-		break;
-	case GL_BGRA:
-		format = GL_BGRA;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat = cmft::TextureFormat::BGRA8;
-		break;
-	case GL_RGBA8:
-		format = GL_RGBA;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat = cmft::TextureFormat::RGBA8;
-		break;
-	case GL_RGBA16:
-		format = GL_RGBA;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat = cmft::TextureFormat::RGBA16;
-		break;
-	case GL_RGBA16F:
-		format = GL_RGBA;
-		dataType = GL_HALF_FLOAT;
-		texFormat = cmft::TextureFormat::RGBA16F;
-		break;
-	case GL_RGBA32F:
-		format = GL_RGBA;
-		dataType = GL_FLOAT;
-		texFormat = cmft::TextureFormat::RGBA32F;
-		break;
-	}
-
-	cmft::Image faceList[6];
+		case GL_RGB16F:		return cmft::TextureFormat::RGBA16F;
+		case GL_RGB32F:		return cmft::TextureFormat::RGB32F;
+		case GL_BGRA:		return cmft::TextureFormat::BGRA8;
+		case GL_RGBA8:		return cmft::TextureFormat::RGBA8;
+		case GL_RGBA16:		return cmft::TextureFormat::RGBA16;
+		case GL_RGBA16F:	return cmft::TextureFormat::RGBA16F;
+		case GL_RGBA32F:
+		default:			return cmft::TextureFormat::RGBA32F;
+		}
+	}
+}
+
+CubemapReadbackRef CubemapReadback::create( const ci::gl::TextureCubeMapRef &cubemap, cmft::TextureFormat::Enum format )
+{
+	return CubemapReadbackRef( new CubemapReadback( cubemap, format ) );
+}
+
+CubemapReadback::CubemapReadback( const ci::gl::TextureCubeMapRef &cubemap, cmft::TextureFormat::Enum format )
+: mFaceSize( cubemap->getWidth() ), mFormat( format != cmft::TextureFormat::Null ? format : getImageFormat( cubemap->getInternalFormat() ) ), mFence( nullptr )
+{
+	GLint internalFormat;
+	GLenum pixelFormat, dataType;
+	if( ! getGlPixelFormat( mFormat, internalFormat, pixelFormat, dataType ) ) {
+		logMessage( LogLevel::Warning, "CubemapReadback: format %d can't be read back", static_cast<int>( mFormat ) );
+		return;
+	}
+
+	// queue the copy of the six faces to a pixel buffer, the gpu does the format conversion
+	const size_t faceDataSize = static_cast<size_t>( mFaceSize ) * mFaceSize * cmft::getImageDataInfo( mFormat ).m_bytesPerPixel;
+	mPbo = gl::Pbo::create( GL_PIXEL_PACK_BUFFER, faceDataSize * CUBE_FACE_NUM, nullptr, GL_STREAM_READ );
+	gl::ScopedBuffer scopedPbo( mPbo );
 	gl::ScopedTextureBind scopedTex( cubemap );
-	for( int face = 0 ; face < 6; ++face ) {
-		cmft::imageCreate( faceList[face], cubemap->getWidth(), cubemap->getHeight(), 0x0, 1, 1, texFormat );
-		glGetTexImage( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, format, dataType, faceList[face].m_data );
+	GLint packAlignment = 4;
+	glGetIntegerv( GL_PACK_ALIGNMENT, &packAlignment );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	for( int face = 0 ; face < CUBE_FACE_NUM; ++face ) {
+		glGetTexImage( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, pixelFormat, dataType, reinterpret_cast<GLvoid*>( face * faceDataSize ) );
+	}
+	glPixelStorei( GL_PACK_ALIGNMENT, packAlignment );
+	mFence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+CubemapReadback::~CubemapReadback()
+{
+	if( mFence ) {
+		glDeleteSync( mFence );
+	}
+}
+
+bool CubemapReadback::isReady()
+{
+	if( ! isValid() ) {
+		return false;
+	}
+	if( ! mFence ) {
+		return true;
+	}
+	GLenum status = glClientWaitSync( mFence, GL_SYNC_FLUSH_COMMANDS_BIT, 0 );
+	return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+bool CubemapReadback::getImage( cmft::Image &output, bool wait )
+{
+	if( ! isValid() || ( ! wait && ! isReady() ) ) {
+		return false;
+	}
+
+	if( cmft::imageIsValid( output ) ) {
+		unloadImage( output );
+	}
+	cmft::imageCreate( output, mFaceSize, mFaceSize, 0x0, 1, CUBE_FACE_NUM, mFormat );
+
+	// a single mip cubemap is stored face after face, exactly like the pixel buffer
+	gl::ScopedBuffer scopedPbo( mPbo );
+	if( void* mapped = mPbo->mapBufferRange( 0, output.m_dataSize, GL_MAP_READ_BIT ) ) {
+		memcpy( output.m_data, mapped, output.m_dataSize );
+		mPbo->unmap();
+		return true;
+	}
+	unloadImage( output );
+	return false;
+}
+
+void textureCubemapToImage( const ci::gl::TextureCubeMapRef &cubemap, cmft::Image &output, cmft::TextureFormat::Enum format )
+{
+	CubemapReadback::create( cubemap, format )->getImage( output, true );
+}
+
+void convertToCubemap( cmft::Image &image ) 
+{
+	if( ! cmft::imageIsCubemap( image ) ) {
+		StageTimer timer( BakeStage::Convert );
+		untrackImage( image );
+		if( cmft::imageIsCubeCross( image ) ) {
+			cmft::imageCubemapFromCross( image );
+		}
+		else if( cmft::imageIsLatLong( image ) ) {
+			cmft::imageCubemapFromLatLong( image );
+		}
+		else if( cmft::imageIsHStrip( image ) || cmft::imageIsVStrip( image ) )	{
+			cmft::imageCubemapFromStrip( image );
+		}
+		else if( cmft::imageIsOctant( image ) )	{
+			cmft::imageCubemapFromOctant( image );
+		}
+		else if( ! cmft::imageCubemapFromCross( image ) ) {
+			CI_LOG_E( "problem converting!!!!" );
+		}
+		trackImage( image );
+	}
+}
+
+TextureStats::TextureStats()
+: mFaceSize( 0 ), mNumMips( 0 ), mInternalFormat( 0 ), mCpuBytes( 0 ), mGpuBytes( 0 ), mUploadTime( 0.0 ), mGpuUploadTime( -1.0 )
+{
+}
+
+namespace {
+	struct TextureRecord {
+		std::weak_ptr<gl::TextureCubeMap>	mTexture;
+		TextureStats						mStats;
+		GLuint								mQuery;		// upload timer query, 0 once resolved or when unsupported
+	};
+
+	struct TextureRegistry {
+		std::mutex					mMutex;
+		// cubemaps uploaded by the block, pruned as they are released
+		std::vector<TextureRecord>	mRecords;
+	};
+
+	TextureRegistry& getTextureRegistry()
+	{
+		static TextureRegistry registry;
+		return registry;
+	}
+
+	// expects the registry mutex to be locked
+	void releaseExpiredTextures( TextureRegistry &registry )
+	{
+		auto expired = std::remove_if( registry.mRecords.begin(), registry.mRecords.end(), []( const TextureRecord &record ) { return record.mTexture.expired(); } );
+		for( auto it = expired; it != registry.mRecords.end(); ++it ) {
+			if( it->mQuery ) {
+				glDeleteQueries( 1, &it->mQuery );
+			}
+		}
+		registry.mRecords.erase( expired, registry.mRecords.end() );
+	}
+
+	// starts timing the gpu side of an upload, returns 0 when timer queries aren't available
+	GLuint beginUploadQuery()
+	{
+		GLuint query = 0;
+#if ! defined( CINDER_GL_ES )
+		static bool timerQueryAvailable = gl::getVersion() >= make_pair( 3, 3 ) || gl::isExtensionAvailable( "GL_ARB_timer_query" );
+		if( timerQueryAvailable ) {
+			glGenQueries( 1, &query );
+			glBeginQuery( GL_TIME_ELAPSED, query );
+		}
+#endif
+		return query;
+	}
+
+	void endUploadQuery( GLuint query )
+	{
+#if ! defined( CINDER_GL_ES )
+		if( query ) {
+			glEndQuery( GL_TIME_ELAPSED );
+		}
+#endif
+	}
+
+	// records an uploaded cubemap, its timer query is read back later by getTextureStats() so that the upload never stalls
+	void registerTexture( const gl::TextureCubeMapRef &cubemap, GLint internalFormat, cmft::TextureFormat::Enum imageFormat, uint32_t faceSize, uint8_t numMips, uint64_t dataSize, double uploadTime, GLuint query )
+	{
+		TextureRecord record;
+		record.mTexture = cubemap;
+		record.mQuery = query;
+
+		auto &stats = record.mStats;
+		auto bakeStats = getActiveBakeStats();
+		stats.mFunction = bakeStats ? bakeStats->mFunction : "createTextureCubemap";
+		stats.mSource = bakeStats ? bakeStats->mSource : ci::fs::path();
+		stats.mFaceSize = faceSize;
+		stats.mNumMips = numMips;
+		stats.mInternalFormat = internalFormat;
+		stats.mCpuBytes = dataSize;
+		stats.mUploadTime = uploadTime;
+
+		// drivers pad three channel texels to four
+		const auto &info = cmft::getImageDataInfo( imageFormat );
+		const uint64_t texelSize = info.m_numChanels == 3 ? info.m_bytesPerPixel / 3 * 4 : info.m_bytesPerPixel;
+		for( uint8_t mip = 0; mip < numMips; ++mip ) {
+			const uint64_t mipFaceSize = glm::max( UINT32_C(1), faceSize >> mip );
+			stats.mGpuBytes += CUBE_FACE_NUM * mipFaceSize * mipFaceSize * texelSize;
+		}
+
+		auto &registry = getTextureRegistry();
+		lock_guard<mutex> lock( registry.mMutex );
+		releaseExpiredTextures( registry );
+		registry.mRecords.push_back( record );
+	}
+}
+
+std::vector<TextureStats> getTextureStats()
+{
+	auto &registry = getTextureRegistry();
+	lock_guard<mutex> lock( registry.mMutex );
+	releaseExpiredTextures( registry );
+
+	std::vector<TextureStats> stats;
+	stats.reserve( registry.mRecords.size() );
+	for( auto &record : registry.mRecords ) {
+#if ! defined( CINDER_GL_ES )
+		if( record.mQuery ) {
+			GLint available = GL_FALSE;
+			glGetQueryObjectiv( record.mQuery, GL_QUERY_RESULT_AVAILABLE, &available );
+			if( available ) {
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v( record.mQuery, GL_QUERY_RESULT, &elapsed );
+				record.mStats.mGpuUploadTime = elapsed * 1e-9;
+				glDeleteQueries( 1, &record.mQuery );
+				record.mQuery = 0;
+			}
+		}
+#endif
+		stats.push_back( record.mStats );
+	}
+	return stats;
+}
+
+namespace {
+	// uploads a cubemap laid out face by face, mip by mip as cmft::Images and dds files are. \a usePixelBuffer streams the data through
+	// a pixel buffer the driver can transfer asynchronously, a file mapping is better read directly than copied to one first
+	ci::gl::TextureCubeMapRef createTextureCubemap( const void *data, uint32_t faceSize, uint8_t numMips, cmft::TextureFormat::Enum imageFormat, const uint32_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM], bool usePixelBuffer )
+	{
+		StageTimer timer( BakeStage::Upload );
+		auto uploadStart = chrono::steady_clock::now();
+		GLuint query = beginUploadQuery();
+
+		// create opengl texture
+		GLint internalFormat = GL_RGB8;
+		GLenum format = GL_RGB, dataType = GL_UNSIGNED_BYTE;
+		getGlPixelFormat( imageFormat, internalFormat, format, dataType );
+		auto texFormat = gl::TextureCubeMap::Format();
+		texFormat.setInternalFormat( internalFormat );
+
+		// the mip chain comes with the data, opengl shouldn't generate it. Mipmapping has to be enabled for cinder to allocate the levels
+		if( numMips > 1 ) {
+			texFormat.enableMipmapping( true );
+			texFormat.setMinFilter( GL_LINEAR_MIPMAP_LINEAR );
+		}
+		texFormat.setBaseMipmapLevel( 0 );
+		texFormat.setMaxMipmapLevel( numMips - 1 );
+
+		// let cinder allocate every face and mip at once with glTexStorage2D when available
+#if ! defined( CINDER_MAC )
+		static bool textureStorageAvailable = gl::getVersion() >= make_pair( 4, 2 ) || gl::isExtensionAvailable( "GL_ARB_texture_storage" );
+		const bool requestImmutableStorage = textureStorageAvailable && internalFormat != GL_BGR && internalFormat != GL_BGRA;
+		texFormat.setImmutableStorage( requestImmutableStorage );
+#endif
+
+		auto cubemap = gl::TextureCubeMap::create( faceSize, faceSize, texFormat );
+
+		// the levels are only uploaded with glTexSubImage2D if the immutable storage holds the whole chain, a mutable texture
+		// gets them specified below. Recreating it is a fallback for drivers or cinder versions not honoring the level count
+		bool immutableStorage = false;
+#if ! defined( CINDER_MAC )
+		if( requestImmutableStorage ) {
+			GLint immutable = GL_FALSE, immutableLevels = 0;
+			{
+				gl::ScopedTextureBind scopedTexBind( cubemap );
+				glGetTexParameteriv( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable );
+				glGetTexParameteriv( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_IMMUTABLE_LEVELS, &immutableLevels );
+			}
+			if( immutable && immutableLevels < numMips ) {
+				texFormat.setImmutableStorage( false );
+				cubemap = gl::TextureCubeMap::create( faceSize, faceSize, texFormat );
+			}
+			else {
+				immutableStorage = immutable != GL_FALSE;
+			}
+		}
+#endif
+		gl::ScopedTextureBind scopedTexBind( cubemap );
+
+		// stream the whole face / mip range through a single mapped pixel buffer, or read it straight from the source memory
+		const uint32_t bytesPerPixel = cmft::getImageDataInfo( imageFormat ).m_bytesPerPixel;
+		const uint32_t lastMipSize = glm::max( UINT32_C(1), faceSize >> ( numMips - 1 ) );
+		const size_t dataBegin = offsets[0][0];
+		const size_t dataSize = offsets[CUBE_FACE_NUM - 1][numMips - 1] + lastMipSize * lastMipSize * bytesPerPixel - dataBegin;
+		const uint8_t* pixelsBase = (const uint8_t*) data + dataBegin;
+
+		gl::PboRef pbo;
+		if( usePixelBuffer ) {
+			pbo = gl::Pbo::create( GL_PIXEL_UNPACK_BUFFER, dataSize, nullptr, GL_STREAM_DRAW );
+			gl::ScopedBuffer scopedPbo( pbo );
+			if( void* mapped = pbo->mapBufferRange( 0, dataSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT ) ) {
+				memcpy( mapped, pixelsBase, dataSize );
+				pbo->unmap();
+			}
+			else {
+				pbo.reset();
+			}
+		}
+
+		GLint unpackAlignment = 4;
+		glGetIntegerv( GL_UNPACK_ALIGNMENT, &unpackAlignment );
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+		gl::ScopedBuffer scopedPbo( GL_PIXEL_UNPACK_BUFFER, pbo ? pbo->getId() : 0 );
+		for( uint8_t face = 0; face < 6; ++face ) {
+			for( uint8_t mip = 0; mip < numMips; ++mip ) {
+				const uint32_t mipFaceSize = glm::max( UINT32_C(1), faceSize >> mip );
+				const size_t offset = offsets[face][mip] - dataBegin;
+				const GLvoid* pixels = pbo ? reinterpret_cast<const GLvoid*>( offset ) : pixelsBase + offset;
+				if( immutableStorage ) {
+					glTexSubImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, 0, 0, mipFaceSize, mipFaceSize, format, dataType, pixels );
+				}
+				else {
+					glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, internalFormat, mipFaceSize, mipFaceSize, 0, format, dataType, pixels );
+				}
+			}
+		}
+		glPixelStorei( GL_UNPACK_ALIGNMENT, unpackAlignment );
+
+		endUploadQuery( query );
+		registerTexture( cubemap, internalFormat, imageFormat, faceSize, numMips, dataSize, chrono::duration<double>( chrono::steady_clock::now() - uploadStart ).count(), query );
+		return cubemap;
+	}
+}
+
+ci::gl::TextureCubeMapRef createTextureCubemap( cmft::Image &image )
+{
+	BakeStatsScope stats( "createTextureCubemap" );
+
+	// Input check.
+    if( ! imageIsCubemap( image ) ) {
+        convertToCubemap( image );
+    }
+
+    // Get source offsets.
+    uint32_t cubemapOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+    cmft::imageGetMipOffsets( cubemapOffsets, image );
+
+	return createTextureCubemap( image.m_data, image.m_width, image.m_numMips, image.m_format, cubemapOffsets, true );
+}
+
+namespace {
+	// read only memory mapping of a whole file
+	class MappedFile {
+	public:
+		MappedFile() : mData( nullptr ), mSize( 0 )
+#if defined( CINDER_MSW )
+			, mFile( INVALID_HANDLE_VALUE ), mMapping( nullptr )
+#endif
+		{}
+		~MappedFile() { close(); }
+
+		bool open( const ci::fs::path &filePath )
+		{
+			close();
+#if defined( CINDER_MSW )
+			mFile = ::CreateFileW( filePath.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+			if( mFile == INVALID_HANDLE_VALUE ) {
+				return false;
+			}
+			LARGE_INTEGER size;
+			if( ! ::GetFileSizeEx( mFile, &size ) || size.QuadPart == 0 ) {
+				close();
+				return false;
+			}
+			mMapping = ::CreateFileMappingW( mFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+			if( ! mMapping ) {
+				close();
+				return false;
+			}
+			mData = static_cast<const uint8_t*>( ::MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 ) );
+			mSize = static_cast<size_t>( size.QuadPart );
+#else
+			int fd = ::open( filePath.string().c_str(), O_RDONLY );
+			if( fd < 0 ) {
+				return false;
+			}
+			struct stat fileStat;
+			if( ::fstat( fd, &fileStat ) != 0 || fileStat.st_size == 0 ) {
+				::close( fd );
+				return false;
+			}
+			void *data = ::mmap( nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+			::close( fd );
+			if( data == MAP_FAILED ) {
+				return false;
+			}
+			::madvise( data, fileStat.st_size, MADV_SEQUENTIAL );
+			mData = static_cast<const uint8_t*>( data );
+			mSize = static_cast<size_t>( fileStat.st_size );
+#endif
+			if( ! mData ) {
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		void close()
+		{
+#if defined( CINDER_MSW )
+			if( mData ) ::UnmapViewOfFile( mData );
+			if( mMapping ) ::CloseHandle( mMapping );
+			if( mFile != INVALID_HANDLE_VALUE ) ::CloseHandle( mFile );
+			mMapping = nullptr;
+			mFile = INVALID_HANDLE_VALUE;
+#else
+			if( mData ) ::munmap( const_cast<uint8_t*>( mData ), mSize );
+#endif
+			mData = nullptr;
+			mSize = 0;
+		}
+
+		const uint8_t*	getData() const { return mData; }
+		size_t			getSize() const { return mSize; }
+
+	protected:
+		MappedFile( const MappedFile& ) = delete;
+		MappedFile& operator=( const MappedFile& ) = delete;
+
+		const uint8_t*	mData;
+		size_t			mSize;
+#if defined( CINDER_MSW )
+		HANDLE			mFile, mMapping;
+#endif
+	};
+
+	// subset of the dds format written by cmft::imageSave
+	const uint32_t DDS_MAGIC				= 0x20534444; // "DDS "
+	const uint32_t DDS_HEADER_SIZE			= 124;
+	const uint32_t DDS_PIXELFORMAT_FOURCC	= 0x4;
+	const uint32_t DDS_CUBEMAP_ALLFACES		= 0xfe00;
+	const uint32_t DDS_FOURCC_DX10			= 0x30315844; // "DX10"
+	const uint32_t D3DFMT_G16R16F			= 112;
+	const uint32_t D3DFMT_A16B16G16R16F		= 113;
+	const uint32_t D3DFMT_A32B32G32R32F		= 116;
+	const uint32_t DXGI_FORMAT_R32G32B32A32_FLOAT	= 2;
+	const uint32_t DXGI_FORMAT_R16G16B16A16_FLOAT	= 10;
+	const uint32_t DXGI_FORMAT_R8G8B8A8_UNORM		= 28;
+
+	// validates the header of a mapped dds cubemap and computes the face / mip offsets into it
+	bool parseDdsCubemap( const MappedFile &file, uint32_t &faceSize, uint8_t &numMips, cmft::TextureFormat::Enum &format, uint32_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM] )
+	{
+		auto data = file.getData();
+		auto readU32 = [data]( size_t offset ) { uint32_t value; memcpy( &value, data + offset, sizeof( uint32_t ) ); return value; };
+
+		// magic + header
+		if( file.getSize() < 4 + DDS_HEADER_SIZE || readU32( 0 ) != DDS_MAGIC || readU32( 4 ) != DDS_HEADER_SIZE ) {
+			return false;
+		}
+		uint32_t height			= readU32( 12 );
+		uint32_t width			= readU32( 16 );
+		uint32_t mipCount		= readU32( 28 );
+		uint32_t pfFlags		= readU32( 80 );
+		uint32_t fourcc			= readU32( 84 );
+		uint32_t caps2			= readU32( 112 );
+		size_t dataOffset		= 4 + DDS_HEADER_SIZE;
+		if( width == 0 || width != height || ( caps2 & DDS_CUBEMAP_ALLFACES ) != DDS_CUBEMAP_ALLFACES || ! ( pfFlags & DDS_PIXELFORMAT_FOURCC ) ) {
+			return false;
+		}
+
+		// dxgi and legacy d3d format codes overlap, each is only matched against its own table
+		if( fourcc == DDS_FOURCC_DX10 ) {
+			if( file.getSize() < dataOffset + 20 ) {
+				return false;
+			}
+			switch( readU32( dataOffset ) ) {
+			case DXGI_FORMAT_R32G32B32A32_FLOAT: format = cmft::TextureFormat::RGBA32F; break;
+			case DXGI_FORMAT_R16G16B16A16_FLOAT: format = cmft::TextureFormat::RGBA16F; break;
+			case DXGI_FORMAT_R8G8B8A8_UNORM: format = cmft::TextureFormat::RGBA8; break;
+			default: return false;
+			}
+			dataOffset += 20;
+		}
+		else {
+			switch( fourcc ) {
+			case D3DFMT_A16B16G16R16F: format = cmft::TextureFormat::RGBA16F; break;
+			case D3DFMT_A32B32G32R32F: format = cmft::TextureFormat::RGBA32F; break;
+			default: return false;
+			}
+		}
+
+		// a longer mip chain than the face size allows would leave the texture incomplete, such files go through the regular load
+		uint32_t maxMips = 1;
+		while( ( width >> maxMips ) > 0 ) {
+			++maxMips;
+		}
+		mipCount = glm::max( 1u, mipCount );
+		if( mipCount > glm::min( maxMips, static_cast<uint32_t>( MAX_MIP_NUM ) ) ) {
+			return false;
+		}
+
+		faceSize = width;
+		numMips = static_cast<uint8_t>( mipCount );
+		const uint32_t bytesPerPixel = cmft::getImageDataInfo( format ).m_bytesPerPixel;
+		size_t offset = dataOffset;
+		for( uint8_t face = 0; face < CUBE_FACE_NUM; ++face ) {
+			for( uint8_t mip = 0; mip < numMips; ++mip ) {
+				const size_t mipFaceSize = glm::max( UINT32_C(1), faceSize >> mip );
+				offsets[face][mip] = static_cast<uint32_t>( offset );
+				offset += mipFaceSize * mipFaceSize * bytesPerPixel;
+			}
+		}
+
+		// truncated file
+		return offset <= file.getSize();
+	}
+
+	// uploads a cached dds cubemap straight from the file mapping, returns a null reference if the file can't be used that way
+	ci::gl::TextureCubeMapRef createTextureCubemapFromCache( const ci::fs::path &cachePath )
+	{
+		MappedFile file;
+		uint32_t faceSize, offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+		uint8_t numMips;
+		cmft::TextureFormat::Enum format;
+		{
+			StageTimer timer( BakeStage::CacheLoad );
+			if( ! file.open( cachePath.string() + ".dds" ) || ! parseDdsCubemap( file, faceSize, numMips, format, offsets ) ) {
+				return nullptr;
+			}
+		}
+		// misses are counted by the image path the callers fall back to. The pages are read during the upload and timed with it
+		recordCacheLookup( true );
+		getMetricsCounters().mBytesRead += file.getSize();
+		return createTextureCubemap( file.getData(), faceSize, numMips, format, offsets, false );
+	}
+}
+
+namespace {
+	bool loadSourceImage( const ci::fs::path &filePath, cmft::Image &output )
+	{
+		StageTimer timer( BakeStage::Load );
+		bool imageLoaded = cmft::imageLoad( output, filePath.string().c_str(), cmft::TextureFormat::RGBA32F )
+						|| cmft::imageLoadStb( output, filePath.string().c_str(), cmft::TextureFormat::RGBA32F );
+	
+		if( ! imageLoaded ) {
+			CI_LOG_E( "Problem loading Image " << filePath );
+		}
+		else {
+			recordBytesRead( filePath );
+			trackImage( output );
+		}
+		return imageLoaded;
+	}
+
+	// bump whenever the content of the cached files changes
+	const uint32_t sCacheFormatVersion = 1;
+
+	struct CacheSettings {
+		std::mutex			mMutex;
+		ci::fs::path		mDirectory;
+		SourceHash::Enum	mSourceHash = SourceHash::SizeAndTime;
+	};
+
+	CacheSettings& getCacheSettings()
+	{
+		static CacheSettings settings;
+		return settings;
+	}
+
+	// 64 bits FNV-1a
+	class Hasher {
+	public:
+		Hasher() : mHash( UINT64_C( 14695981039346656037 ) ) {}
+
+		void add( const void *data, size_t size )
+		{
+			auto bytes = static_cast<const uint8_t*>( data );
+			for( size_t i = 0; i < size; ++i ) {
+				mHash = ( mHash ^ bytes[i] ) * UINT64_C( 1099511628211 );
+			}
+		}
+		// word sized variant used for file contents
+		void addWords( const void *data, size_t size )
+		{
+			auto words = static_cast<const uint8_t*>( data );
+			size_t numWords = size / sizeof( uint64_t );
+			for( size_t i = 0; i < numWords; ++i ) {
+				uint64_t word;
+				memcpy( &word, words + i * sizeof( uint64_t ), sizeof( uint64_t ) );
+				mHash = ( mHash ^ word ) * UINT64_C( 1099511628211 );
+			}
+			add( words + numWords * sizeof( uint64_t ), size % sizeof( uint64_t ) );
+		}
+		template<typename T>
+		void add( const T &value )
+		{
+			add( &value, sizeof( T ) );
+		}
+		void add( const std::string &value )
+		{
+			add( value.data(), value.size() );
+		}
+
+		uint64_t get() const { return mHash; }
+
+	protected:
+		uint64_t mHash;
+	};
+
+	uint64_t hashSourceFile( const ci::fs::path &filePath )
+	{
+		CMFT_TRACE_SCOPE( "hash source" );
+		Hasher hasher;
+		if( ! fs::exists( filePath ) ) {
+			return hasher.get();
+		}
+
+		SourceHash::Enum mode;
+		{
+			auto &settings = getCacheSettings();
+			lock_guard<mutex> lock( settings.mMutex );
+			mode = settings.mSourceHash;
+		}
+
+		hasher.add( static_cast<uint64_t>( fs::file_size( filePath ) ) );
+		if( mode == SourceHash::Content ) {
+			std::ifstream file( filePath.string(), std::ios::binary );
+			std::vector<char> buffer( 1 << 20 );
+			while( file ) {
+				file.read( buffer.data(), buffer.size() );
+				hasher.addWords( buffer.data(), static_cast<size_t>( file.gcount() ) );
+			}
+		}
+		else {
+			auto lastWriteTime = fs::last_write_time( filePath );
+			hasher.add( lastWriteTime );
+		}
+		return hasher.get();
+	}
+
+	uint64_t hashOptions( const RadianceFilterOptions &options )
+	{
+		// only the options affecting the filtered result, the backend only where it changes the result
+		Hasher hasher;
+		hasher.add( options.mExcludeBase );
+		hasher.add( static_cast<int32_t>( options.mEdgeFixup ) );
+		hasher.add( options.mGammaInput );
+		hasher.add( options.mGammaOutput );
+		hasher.add( options.mMipCount );
+		// the ggx lobes only depend on the roughness of each mip, every backend runs the same filter
+		if( options.mFilterMode == RadianceFilterMode::Ggx ) {
+			hasher.add( static_cast<int32_t>( options.mFilterMode ) );
+			hasher.add( options.mGgxSampleCount );
+			return hasher.get();
+		}
+		hasher.add( static_cast<int32_t>( options.mLightingModel ) );
+		hasher.add( options.mGlossScale );
+		hasher.add( options.mGlossBias );
+		// the native filter differs slightly from cmft's, only hashed when used so that the existing cmft entries stay valid
+		if( options.mBackend == ComputeBackend::NativeCpu ) {
+			hasher.add( static_cast<int32_t>( options.mBackend ) );
+		}
+		return hasher.get();
+	}
+
+	uint64_t hashOptions( const IrradianceFilterOptions &options )
+	{
+		Hasher hasher;
+		hasher.add( options.mGammaInput );
+		hasher.add( options.mGammaOutput );
+		return hasher.get();
+	}
+
+	// returns the cache path of \a filePath without the file extension. 
+	// the name is keyed on the source, the output size and options so that stale results are never reused
+	ci::fs::path getCachePath( const ci::fs::path &filePath, uint64_t sourceHash, const std::string &suffix, uint32_t dstFaceSize, uint64_t optionsHash )
+	{
+		Hasher hasher;
+		hasher.add( sCacheFormatVersion );
+		hasher.add( sourceHash );
+		hasher.add( suffix );
+		hasher.add( dstFaceSize );
+		hasher.add( optionsHash );
+
+		char key[17];
+		snprintf( key, sizeof( key ), "%016llx", static_cast<unsigned long long>( hasher.get() ) );
+
+		auto directory = getCacheDirectory();
+		if( directory.empty() ) {
+			directory = filePath.parent_path();
+		}
+		return directory / ( filePath.filename().stem().string() + suffix + "_" + key );
+	}
+	ci::fs::path getPmremCachePath( const ci::fs::path &filePath, uint64_t sourceHash, uint32_t dstFaceSize, const RadianceFilterOptions &options )
+	{
+		return getCachePath( filePath, sourceHash, "_pmrem", dstFaceSize, hashOptions( options ) );
+	}
+	ci::fs::path getIemCachePath( const ci::fs::path &filePath, uint64_t sourceHash, uint32_t dstFaceSize, const IrradianceFilterOptions &options )
+	{
+		return getCachePath( filePath, sourceHash, "_iem", dstFaceSize, hashOptions( options ) );
+	}
+	// the skybox keeps the source resolution, which is only known once decoded
+	ci::fs::path getEmCachePath( const ci::fs::path &filePath, uint64_t sourceHash )
+	{
+		return getCachePath( filePath, sourceHash, "_em", 0, 0 );
+	}
+
+	// cached files are loaded in their stored half float format and uploaded as is by createTextureCubemap
+	const cmft::TextureFormat::Enum sCacheFormat = cmft::TextureFormat::RGBA16F;
+
+	bool loadCachedImage( const ci::fs::path &cachePath, cmft::Image &output )
+	{
+		StageTimer timer( BakeStage::CacheLoad );
+		auto ddsPath = cachePath.string() + ".dds";
+		bool loaded = fs::exists( ddsPath ) && 
+			( cmft::imageLoad( output, ddsPath.c_str(), sCacheFormat )
+			|| cmft::imageLoadStb( output, ddsPath.c_str(), sCacheFormat ) );
+		recordCacheLookup( loaded );
+		if( loaded ) {
+			recordBytesRead( ddsPath );
+			trackImage( output );
+		}
+		return loaded;
+	}
+
+	const size_t sCacheKeyLength = 16;
+
+	// returns whether \a path is exactly <prefix><16 hex digits key>.dds, prefix being <source stem><suffix>_
+	bool isKeyedCacheFile( const ci::fs::path &path, const std::string &prefix )
+	{
+		const auto fileName = path.filename().string();
+		return path.extension() == ".dds" && fileName.size() == prefix.size() + sCacheKeyLength + 4 && fileName.compare( 0, prefix.size(), prefix ) == 0
+			&& fileName.find_first_not_of( "0123456789abcdef", prefix.size() ) == prefix.size() + sCacheKeyLength;
+	}
+
+	// removes the <stem><suffix>_<key>.dds siblings of \a cachePath written before the last change of the source at \a filePath.
+	// they were baked from a previous version of the source, the ones of other sizes or options are still valid
+	void removeStaleCachedImages( const ci::fs::path &cachePath, const ci::fs::path &filePath )
+	{
+		const auto name = cachePath.filename().string();
+		if( name.size() <= sCacheKeyLength ) {
+			return;
+		}
+		const auto prefix = name.substr( 0, name.size() - sCacheKeyLength );
+		try {
+			const auto sourceTime = fs::last_write_time( filePath );
+			std::vector<ci::fs::path> stale;
+			for( fs::directory_iterator it( cachePath.parent_path().empty() ? ci::fs::path( "." ) : cachePath.parent_path() ), end; it != end; ++it ) {
+				if( isKeyedCacheFile( it->path(), prefix ) && it->path().stem().string() != name && fs::last_write_time( it->path() ) < sourceTime ) {
+					stale.push_back( it->path() );
+				}
+			}
+			for( const auto &path : stale ) {
+				fs::remove( path );
+			}
+		}
+		catch( const std::exception & ) {
+		}
+	}
+
+	void saveCachedImage( const ci::fs::path &cachePath, const cmft::Image &image, const ci::fs::path &filePath )
+	{
+		StageTimer timer( BakeStage::CacheSave );
+		if( ! cachePath.parent_path().empty() && ! fs::exists( cachePath.parent_path() ) ) {
+			fs::create_directories( cachePath.parent_path() );
+		}
+		cmft::imageSave( image, cachePath.string().c_str(), ImageFileType::DDS, OutputType::Cubemap, sCacheFormat, true );
+		recordBytesWritten( cachePath.string() + ".dds" );
+		removeStaleCachedImages( cachePath, filePath );
+	}
+}
+
+void setCacheDirectory( const ci::fs::path &directory )
+{
+	auto &settings = getCacheSettings();
+	lock_guard<mutex> lock( settings.mMutex );
+	settings.mDirectory = directory;
+}
+
+ci::fs::path getCacheDirectory()
+{
+	auto &settings = getCacheSettings();
+	lock_guard<mutex> lock( settings.mMutex );
+	return settings.mDirectory;
+}
+
+void setCacheSourceHash( SourceHash::Enum mode )
+{
+	auto &settings = getCacheSettings();
+	lock_guard<mutex> lock( settings.mMutex );
+	settings.mSourceHash = mode;
+}
+
+ci::gl::TextureCubeMapRef createTextureCubemap( const ci::fs::path &filePath )
+{
+	BakeStatsScope stats( "createTextureCubemap", filePath );
+
+	cmft::Image input;
+	loadSourceImage( filePath, input );
+
+	auto outputTex = createTextureCubemap( input );
+
+	// release image memory
+	unloadImage( input );
+
+	return outputTex;
+}
+
+
+RadianceFilterOptions& RadianceFilterOptions::gammaCorrection( float gammaInput, float gammaOutput )
+{
+	mGammaInput = gammaInput;
+	mGammaOutput = gammaOutput;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::lightingModel( LightingModel::Enum model )
+{
+	mLightingModel = model;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::edgeFixup( EdgeFixup::Enum fixup )
+{
+	mEdgeFixup = fixup;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::mipCount( uint8_t mips )
+{
+	mMipCount = mips;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::glossScale( uint8_t scale )
+{
+	mGlossScale = scale;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::glossBias( uint8_t bias )
+{
+	mGlossBias = bias;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::numCpuProcessingThreads( uint8_t numThreads )
+{
+	mNumCpuProcessingThreads = numThreads;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::excludeBase( bool exclude )
+{
+	mExcludeBase = exclude;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::backend( ComputeBackend::Enum backend )
+{
+	mBackend = backend;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::clContext( ClContext *context )
+{
+	mClContext = context;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::filterMode( RadianceFilterMode::Enum mode )
+{
+	mFilterMode = mode;
+	return *this;
+}
+RadianceFilterOptions& RadianceFilterOptions::ggxSampleCount( uint32_t count )
+{
+	mGgxSampleCount = count;
+	return *this;
+}
+
+namespace {
+	struct PooledClContext {
+		ClContext*	mContext;
+		uint32_t	mVendor, mDeviceType;
+		bool		mInUse;
+	};
+
+	struct ClContextPool {
+		std::mutex						mMutex;
+		std::vector<PooledClContext>	mContexts;
+		// vendor / device type pairs that already failed to initialize
+		std::vector<std::pair<uint32_t, uint32_t>> mUnavailable;
+		bool							mClLoaded = false;
+		bool							mClAvailable = false;
+		// set by destroyClContextPool, the contexts still in use are destroyed when released
+		bool							mShutdown = false;
+	};
+
+	ClContextPool& getClContextPool()
+	{
+		static ClContextPool pool;
+		return pool;
+	}
+
+	void stopWorkerPool();
+
+	// connects the block shutdown to the app cleanup signal once. Cinder signals aren't thread safe,
+	// so the connection is dispatched to the main thread when requested from a worker thread
+	void connectAppCleanup()
+	{
+		static std::atomic<bool> sConnected( false );
+		auto app = app::App::get();
+		if( ! app || sConnected.exchange( true ) ) {
+			return;
+		}
+
+		auto connect = []() {
+			if( auto app = app::App::get() ) {
+				app->getSignalCleanup().connect( []() {
+					stopWorkerPool();
+					destroyClContextPool();
+				} );
+			}
+		};
+		if( app::isMainThread() ) {
+			connect();
+		}
+		else {
+			app->dispatchAsync( connect );
+		}
+	}
+
+	// expects the pool mutex to be locked
+	bool loadCl( ClContextPool &pool )
+	{
+		if( ! pool.mClLoaded ) {
+			pool.mClAvailable = bx::clLoad() > 0;
+			pool.mClLoaded = true;
+			connectAppCleanup();
+		}
+		return pool.mClAvailable;
+	}
+
+	// expects the pool mutex to be locked. OpenCL is only unloaded once the last context is gone
+	void destroyPooledClContext( ClContextPool &pool, std::vector<PooledClContext>::iterator it )
+	{
+		it->mContext->destroy();
+		delete it->mContext;
+		pool.mContexts.erase( it );
+		if( pool.mContexts.empty() && pool.mClAvailable ) {
+			bx::clUnload();
+			pool.mClAvailable = false;
+		}
+	}
+}
+
+ClContext* acquireClContext( uint32_t vendor, uint32_t deviceType )
+{
+	auto &pool = getClContextPool();
+	lock_guard<mutex> lock( pool.mMutex );
+
+	// the app is shutting down, the callers fall back to the cpu
+	if( pool.mShutdown ) {
+		return nullptr;
+	}
+
+	// reuse an idle context created with the same parameters
+	for( auto &pooled : pool.mContexts ) {
+		if( ! pooled.mInUse && pooled.mVendor == vendor && pooled.mDeviceType == deviceType ) {
+			pooled.mInUse = true;
+			return pooled.mContext;
+		}
+	}
+
+	// don't go through device enumeration again if it already failed
+	if( ! loadCl( pool ) || find( pool.mUnavailable.begin(), pool.mUnavailable.end(), make_pair( vendor, deviceType ) ) != pool.mUnavailable.end() ) {
+		return nullptr;
+	}
+
+	auto context = new ClContext();
+	if( ! context->init( (uint8_t) vendor, deviceType ) ) {
+		delete context;
+		pool.mUnavailable.push_back( make_pair( vendor, deviceType ) );
+		return nullptr;
+	}
+
+	pool.mContexts.push_back( { context, vendor, deviceType, true } );
+	++getMetricsCounters().mClContextCreations;
+	return context;
+}
+
+void releaseClContext( ClContext *context )
+{
+	auto &pool = getClContextPool();
+	lock_guard<mutex> lock( pool.mMutex );
+	auto it = find_if( pool.mContexts.begin(), pool.mContexts.end(), [context]( const PooledClContext &pooled ) { return pooled.mContext == context; } );
+	if( it == pool.mContexts.end() ) {
+		return;
+	}
+	if( pool.mShutdown ) {
+		destroyPooledClContext( pool, it );
+	}
+	else {
+		it->mInUse = false;
+	}
+}
+
+void destroyClContextPool()
+{
+	auto &pool = getClContextPool();
+	lock_guard<mutex> lock( pool.mMutex );
+	pool.mShutdown = true;
+
+	// the contexts held by a FilterPlan or a running bake are destroyed by releaseClContext
+	for( auto it = pool.mContexts.begin(); it != pool.mContexts.end(); ) {
+		if( it->mInUse ) {
+			++it;
+		}
+		else {
+			destroyPooledClContext( pool, it );
+			it = pool.mContexts.begin();
+		}
+	}
+	if( pool.mContexts.empty() && pool.mClAvailable ) {
+		bx::clUnload();
+		pool.mClAvailable = false;
+	}
+}
+
+namespace {
+	// returns the opencl context matching the requested backend or nullptr when filtering on cpu threads, and the backend it ends up on
+	ClContext* acquireBackendClContext( const RadianceFilterOptions &options, ComputeBackend::Enum *backend )
+	{
+		ClContext *context = nullptr;
+		*backend = ComputeBackend::Cpu;
+		switch( options.mBackend ) {
+		case ComputeBackend::Cpu:
+		case ComputeBackend::NativeCpu:
+			break;
+		case ComputeBackend::OpenClGpu:
+			context = acquireClContext( CMFT_CL_VENDOR_ANY_GPU, CMFT_CL_DEVICE_TYPE_GPU );
+			*backend = context ? ComputeBackend::OpenClGpu : ComputeBackend::Cpu;
+			break;
+		case ComputeBackend::OpenClCpu:
+			context = acquireClContext( CMFT_CL_VENDOR_ANY_CPU, CMFT_CL_DEVICE_TYPE_CPU );
+			*backend = context ? ComputeBackend::OpenClCpu : ComputeBackend::Cpu;
+			break;
+		case ComputeBackend::Auto:
+		default:
+			if( ( context = acquireClContext( CMFT_CL_VENDOR_ANY_GPU, CMFT_CL_DEVICE_TYPE_GPU ) ) ) {
+				*backend = ComputeBackend::OpenClGpu;
+			}
+			else if( ( context = acquireClContext( CMFT_CL_VENDOR_ANY_CPU, CMFT_CL_DEVICE_TYPE_CPU ) ) ) {
+				*backend = ComputeBackend::OpenClCpu;
+			}
+			break;
+		}
+		return context;
+	}
+}
+
+bool createPmrem( cmft::Image &input, cmft::Image &output, uint32_t dstFaceSize, const RadianceFilterOptions &options )
+{
+	BakeStatsScope stats( "createPmrem" );
+	return FilterPlan::create( dstFaceSize, options )->execute( input, output );
+}
+gl::TextureCubeMapRef createPmrem( cmft::Image &input, uint32_t dstFaceSize, const RadianceFilterOptions &options )
+{
+	BakeStatsScope stats( "createPmrem" );
+
+	// prepare and generate output
+	cmft::Image output;	
+	createPmrem( input, output, dstFaceSize, options );
+
+	// generate the opengl cubemap texture
+	auto outputTex = createTextureCubemap( output );
+
+	// release image memory
+	unloadImage( output );
+
+	return outputTex;
+}
+
+ci::gl::TextureCubeMapRef createPmrem( const ci::Surface &source, uint32_t dstFaceSize, const RadianceFilterOptions &options )
+{
+	BakeStatsScope stats( "createPmrem" );
+
+	cmft::Image input;
+	surfaceToImage( source, input );
+	
+	// generate the opengl cubemap texture
+	auto outputTex = createPmrem( input, dstFaceSize, options );
+	
+	// Release output image memory
+	unloadImage( input );
+
+	return outputTex;
+}
+
+namespace {
+	// loads and filters the source at \a filePath, reading and writing the cache at \a cachePath unless it is empty
+	bool createPmremFromFile( const ci::fs::path &filePath, const ci::fs::path &cachePath, cmft::Image &output, uint32_t dstFaceSize, const RadianceFilterOptions &options )
+	{
+		// reuse the cached results if any
+		if( ! cachePath.empty() && loadCachedImage( cachePath, output ) ) {
+			return true;
+		}
+
+		// otherwise load the original file and apply the radiance filter
+		cmft::Image input;
+		if( ! loadSourceImage( filePath, input ) ) {
+			return false;
+		}
+		
+		bool filtered = createPmrem( input, output, dstFaceSize, options );
+		unloadImage( input );
+		
+		// save results if caching is enabled
+		if( filtered && ! cachePath.empty() ) {
+			saveCachedImage( cachePath, output, filePath );
+		}
+
+		return filtered;
+	}
+}
+
+bool createPmrem( const ci::fs::path &filePath, cmft::Image &output, uint32_t dstFaceSize, const RadianceFilterOptions &options, bool cacheEnabled )
+{
+	BakeStatsScope stats( "createPmrem", filePath );
+	auto cachePath = cacheEnabled ? getPmremCachePath( filePath, hashSourceFile( filePath ), dstFaceSize, options ) : ci::fs::path();
+	return createPmremFromFile( filePath, cachePath, output, dstFaceSize, options );
+}
+ci::gl::TextureCubeMapRef createPmrem( const ci::fs::path &filePath, uint32_t dstFaceSize, const RadianceFilterOptions &options, bool cacheEnabled )
+{
+	BakeStatsScope stats( "createPmrem", filePath );
+
+	// upload cached results straight from the file, the source is hashed a single time
+	auto cachePath = cacheEnabled ? getPmremCachePath( filePath, hashSourceFile( filePath ), dstFaceSize, options ) : ci::fs::path();
+	if( ! cachePath.empty() ) {
+		if( auto cached = createTextureCubemapFromCache( cachePath ) ) {
+			return cached;
+		}
+	}
+
+	cmft::Image output;
+	createPmremFromFile( filePath, cachePath, output, dstFaceSize, options );
+	
+	// generate the opengl cubemap texture
+	auto outputTex = createTextureCubemap( output ); 
+	
+	// Release output image memory
+	unloadImage( output );
+	
+	return outputTex;
+}
+
+namespace {
+	// samples per texel of the brdf lookup table, bump sCacheFormatVersion when changing it
+	const uint32_t sBrdfLutSampleCount = 1024;
+
+	ci::fs::path getBrdfLutCachePath( uint32_t size, const RadianceFilterOptions &options )
+	{
+		// only the options changing the distribution
+		Hasher hasher;
+		hasher.add( sCacheFormatVersion );
+		hasher.add( size );
+		hasher.add( static_cast<int32_t>( options.mFilterMode ) );
+		if( options.mFilterMode == RadianceFilterMode::CosinePower ) {
+			hasher.add( static_cast<int32_t>( options.mLightingModel ) );
+			hasher.add( options.mGlossScale );
+			hasher.add( options.mGlossBias );
+		}
+
+		char key[17];
+		snprintf( key, sizeof( key ), "%016llx", static_cast<unsigned long long>( hasher.get() ) );
+
+		auto directory = getCacheDirectory();
+		if( directory.empty() ) {
+			directory = fs::temp_directory_path();
+		}
+		return directory / ( "brdf_lut_" + string( key ) + ".dds" );
+	}
+
+	bool loadBrdfLut( const ci::fs::path &cachePath, uint32_t size, std::vector<uint32_t> &output )
+	{
+		StageTimer timer( BakeStage::CacheLoad );
+		MappedFile file;
+		if( ! file.open( cachePath ) ) {
+			recordCacheLookup( false );
+			return false;
+		}
+
+		auto data = file.getData();
+		auto readU32 = [data]( size_t offset ) { uint32_t value; memcpy( &value, data + offset, sizeof( uint32_t ) ); return value; };
+		const size_t dataOffset = 4 + DDS_HEADER_SIZE;
+		const size_t dataSize = static_cast<size_t>( size ) * size * sizeof( uint32_t );
+		if( file.getSize() < dataOffset + dataSize || readU32( 0 ) != DDS_MAGIC || readU32( 4 ) != DDS_HEADER_SIZE
+			|| readU32( 12 ) != size || readU32( 16 ) != size || readU32( 84 ) != D3DFMT_G16R16F ) {
+			recordCacheLookup( false );
+			return false;
+		}
+
+		output.resize( static_cast<size_t>( size ) * size );
+		memcpy( output.data(), data + dataOffset, dataSize );
+		recordCacheLookup( true );
+		getMetricsCounters().mBytesRead += dataOffset + dataSize;
+		return true;
+	}
+
+	void saveBrdfLut( const ci::fs::path &cachePath, uint32_t size, const std::vector<uint32_t> &lut )
+	{
+		StageTimer timer( BakeStage::CacheSave );
+		if( ! cachePath.parent_path().empty() && ! fs::exists( cachePath.parent_path() ) ) {
+			fs::create_directories( cachePath.parent_path() );
+		}
+
+		// minimal single level dds header
+		uint32_t header[32] = {};
+		header[0]	= DDS_MAGIC;
+		header[1]	= DDS_HEADER_SIZE;
+		header[2]	= 0x1007;					// caps, height, width and pixel format
+		header[3]	= size;
+		header[4]	= size;
+		header[7]	= 1;						// mip count
+		header[19]	= 32;						// pixel format size
+		header[20]	= DDS_PIXELFORMAT_FOURCC;
+		header[21]	= D3DFMT_G16R16F;
+		header[27]	= 0x1000;					// texture caps
+
+		// written to a temporary file first so that a concurrent reader never sees a partial table. The temporary name is unique
+		// to the process and thread, two bakes of the same table would otherwise write to the same file before renaming it
+#if defined( CINDER_MSW )
+		const unsigned long processId = GetCurrentProcessId();
+#else
+		const unsigned long processId = static_cast<unsigned long>( getpid() );
+#endif
+		char suffix[64];
+		snprintf( suffix, sizeof( suffix ), ".%lu_%llx.tmp", processId, static_cast<unsigned long long>( std::hash<std::thread::id>()( std::this_thread::get_id() ) ) );
+		auto tempPath = cachePath.string() + suffix;
+		bool written;
+		{
+			std::ofstream file( tempPath, std::ios::binary );
+			file.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+			file.write( reinterpret_cast<const char*>( lut.data() ), lut.size() * sizeof( uint32_t ) );
+			written = static_cast<bool>( file );
+		}
+		// the throwing overloads, ci::fs is boost::filesystem on some platforms and its error_code isn't std::error_code
+		try {
+			if( written ) {
+				fs::rename( tempPath, cachePath );
+				getMetricsCounters().mBytesWritten += sizeof( header ) + lut.size() * sizeof( uint32_t );
+			}
+			else {
+				fs::remove( tempPath );
+			}
+		}
+		catch( const std::exception & ) {
+			std::remove( tempPath.c_str() );
+		}
+	}
+}
+
+bool createBrdfLut( std::vector<uint32_t> &output, uint32_t size, const RadianceFilterOptions &options, bool cacheEnabled )
+{
+	BakeStatsScope stats( "createBrdfLut" );
+	if( ! size ) {
+		return false;
+	}
+
+	auto cachePath = getBrdfLutCachePath( size, options );
+	if( cacheEnabled && loadBrdfLut( cachePath, size, output ) ) {
+		return true;
+	}
+
+	// ggx, or the blinn-phong distribution the pmrem lobes were derived from
+	std::function<float( float )> getBlinnPower;
+	if( options.mFilterMode == RadianceFilterMode::CosinePower ) {
+		getBlinnPower = [options]( float roughness ) {
+			const float power = std::exp2( options.mGlossScale * ( 1.0f - roughness ) + options.mGlossBias );
+			// phong lobes are around the reflection vector, their half vector power is about four times larger
+			const bool phong = options.mLightingModel == LightingModel::Phong || options.mLightingModel == LightingModel::PhongBrdf;
+			return phong ? power * 4.0f : power;
+		};
+	}
+
+	{
+		StageTimer timer( BakeStage::BrdfLut );
+		std::vector<float> lut( static_cast<size_t>( size ) * size * 2 );
+		detail::integrateBrdf( lut.data(), size, sBrdfLutSampleCount, getBlinnPower, options.mNumCpuProcessingThreads );
+
+		output.resize( static_cast<size_t>( size ) * size );
+		for( size_t i = 0; i < output.size(); ++i ) {
+			output[i] = glm::packHalf2x16( vec2( lut[i * 2], lut[i * 2 + 1] ) );
+		}
+	}
+
+	if( cacheEnabled ) {
+		saveBrdfLut( cachePath, size, output );
+	}
+	return true;
+}
+ci::gl::Texture2dRef createBrdfLut( uint32_t size, const RadianceFilterOptions &options, bool cacheEnabled )
+{
+	BakeStatsScope stats( "createBrdfLut" );
+	std::vector<uint32_t> lut;
+	if( ! createBrdfLut( lut, size, options, cacheEnabled ) ) {
+		return nullptr;
+	}
+
+	StageTimer timer( BakeStage::Upload );
+	auto format = gl::Texture2d::Format().internalFormat( GL_RG16F ).dataType( GL_HALF_FLOAT ).minFilter( GL_LINEAR ).magFilter( GL_LINEAR ).wrap( GL_CLAMP_TO_EDGE );
+	return gl::Texture2d::create( lut.data(), GL_RG, size, size, format );
+}
+
+IrradianceFilterOptions& IrradianceFilterOptions::gammaCorrection( float gammaInput, float gammaOutput )
+{
+	mGammaInput = gammaInput;
+	mGammaOutput = gammaOutput;
+	return *this;
+}
+
+bool createIem( cmft::Image &input, cmft::Image &output, uint32_t dstFaceSize, const IrradianceFilterOptions &options )
+{
+	BakeStatsScope stats( "createIem" );
+	return FilterPlan::create( dstFaceSize, options )->execute( input, output );
+}
+ci::gl::TextureCubeMapRef createIem( cmft::Image &input, uint32_t dstFaceSize, const IrradianceFilterOptions &options )
+{	
+	BakeStatsScope stats( "createIem" );
+
+	// generate output
+	cmft::Image output;
+	createIem( input, output, dstFaceSize, options );
+
+	// generate the opengl cubemap texture
+	auto outputTex = createTextureCubemap( output );
+
+	// release image memory
+	unloadImage( output );
+
+	return outputTex;
+}
+
+ci::gl::TextureCubeMapRef createIem( const ci::Surface &source, uint32_t dstFaceSize, const IrradianceFilterOptions &options )
+{
+	BakeStatsScope stats( "createIem" );
+
+	cmft::Image input;
+	surfaceToImage( source, input );
+
+	// generate the opengl cubemap texture
+	auto outputTex = createIem( input, dstFaceSize, options );
+
+	// release image memory
+	unloadImage( input );
+	
+	return outputTex;
+}
+
+namespace {
+	// loads and filters the source at \a filePath, reading and writing the cache at \a cachePath unless it is empty
+	bool createIemFromFile( const ci::fs::path &filePath, const ci::fs::path &cachePath, cmft::Image &output, uint32_t dstFaceSize, const IrradianceFilterOptions &options )
+	{
+		// reuse the cached results if any
+		if( ! cachePath.empty() && loadCachedImage( cachePath, output ) ) {
+			return true;
+		}
+
+		// otherwise load the original file and apply the irradiance filter
+		cmft::Image input;
+		if( ! loadSourceImage( filePath, input ) ) {
+			return false;
+		}
+
+		bool filtered = createIem( input, output, dstFaceSize, options );
+
+		// save results if caching is enabled
+		if( filtered && ! cachePath.empty() ) {
+			saveCachedImage( cachePath, output, filePath );
+		}
+
+		// release image memory
+		unloadImage( input );
+
+		return filtered;
+	}
+}
+
+bool createIem( const ci::fs::path &filePath, cmft::Image &output, uint32_t dstFaceSize, const IrradianceFilterOptions &options, bool cacheEnabled )
+{
+	BakeStatsScope stats( "createIem", filePath );
+	auto cachePath = cacheEnabled ? getIemCachePath( filePath, hashSourceFile( filePath ), dstFaceSize, options ) : ci::fs::path();
+	return createIemFromFile( filePath, cachePath, output, dstFaceSize, options );
+}
+ci::gl::TextureCubeMapRef createIem( const ci::fs::path &filePath, uint32_t dstFaceSize, const IrradianceFilterOptions &options, bool cacheEnabled )
+{
+	BakeStatsScope stats( "createIem", filePath );
+
+	// upload cached results straight from the file, the source is hashed a single time
+	auto cachePath = cacheEnabled ? getIemCachePath( filePath, hashSourceFile( filePath ), dstFaceSize, options ) : ci::fs::path();
+	if( ! cachePath.empty() ) {
+		if( auto cached = createTextureCubemapFromCache( cachePath ) ) {
+			return cached;
+		}
+	}
+
+	cmft::Image output;
+	createIemFromFile( filePath, cachePath, output, dstFaceSize, options );
+	
+	auto outputTex = createTextureCubemap( output );
+
+	// release image memory
+	unloadImage( output );
+	
+	return outputTex;
+}
+
+bool createIemSh( cmft::Image &input, ShCoeffs &coeffs, const IrradianceFilterOptions &options )
+{
+	BakeStatsScope stats( "createIemSh" );
+
+	if( ! cmft::imageIsCubemap( input ) ) {
+		convertToCubemap( input );
+	}
+
+	if( ! cmft::imageIsValid( input ) ) {
+		return false;
+	}
+	if( input.m_format != cmft::TextureFormat::RGBA32F ) {
+		StageTimer timer( BakeStage::Convert );
+		untrackImage( input );
+		cmft::imageConvert( input, cmft::TextureFormat::RGBA32F );
+		trackImage( input );
+	}
+
+	// project the radiance
+	double shRgb[SH_COEFF_NUM][3];
+	{
+		StageTimer timer( BakeStage::Gamma );
+		cmft::imageApplyGamma( input, options.mGammaInput );
+	}
+	{
+		StageTimer timer( BakeStage::Sh );
+		detail::projectSh( input, shRgb );
+	}
+
+	// and convolve it with the clamped cosine lobe, divided by pi like the iem cubemaps
+	static const double bandFactors[SH_COEFF_NUM] = { 1.0, 2.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0, 0.25, 0.25, 0.25, 0.25, 0.25 };
+	for( uint8_t i = 0; i < SH_COEFF_NUM; ++i ) {
+		coeffs[i] = vec3( shRgb[i][0], shRgb[i][1], shRgb[i][2] ) * static_cast<float>( bandFactors[i] );
+	}
+	return true;
+}
+bool createIemSh( const ci::Surface &source, ShCoeffs &coeffs, const IrradianceFilterOptions &options )
+{
+	BakeStatsScope stats( "createIemSh" );
+
+	cmft::Image input;
+	surfaceToImage( source, input );
+
+	bool projected = createIemSh( input, coeffs, options );
+
+	// release image memory
+	unloadImage( input );
+
+	return projected;
+}
+bool createIemSh( const ci::fs::path &filePath, ShCoeffs &coeffs, const IrradianceFilterOptions &options )
+{
+	BakeStatsScope stats( "createIemSh", filePath );
+
+	cmft::Image input;
+	if( ! loadSourceImage( filePath, input ) ) {
+		return false;
+	}
+
+	bool projected = createIemSh( input, coeffs, options );
+
+	// release image memory
+	unloadImage( input );
+
+	return projected;
+}
+
+FilterPlan::FilterPlan( uint32_t dstFaceSize, bool radiance )
+: mRadiance( radiance ), mFaceSize( dstFaceSize ), mMipCount( 1 ), mClContext( nullptr ), mPooledClContext( false ), mBackend( ComputeBackend::NativeCpu )
+{
+}
+
+FilterPlan::~FilterPlan()
+{
+	// give the opencl context back to the pool
+	if( mClContext && mPooledClContext ) {
+		releaseClContext( mClContext );
+	}
+}
+
+FilterPlanRef FilterPlan::create( uint32_t dstFaceSize, const RadianceFilterOptions &options )
+{
+	StageTimer timer( BakeStage::Filter );
+	FilterPlanRef plan( new FilterPlan( dstFaceSize, true ) );
+	plan->mRadianceOptions = options;
+
+	// a face can't have more mips than its size allows
+	uint8_t maxMipCount = 1;
+	while( ( dstFaceSize >> maxMipCount ) > 0 && maxMipCount < MAX_MIP_NUM ) {
+		++maxMipCount;
+	}
+	plan->mMipCount = glm::max<uint8_t>( 1, glm::min( options.mMipCount, maxMipCount ) );
+
+	plan->mSourceLevels.assign( plan->mMipCount, 0 );
+
+	// the ggx samples only depend on the roughness of each mip, the gloss and lighting model don't apply
+	if( options.mFilterMode == RadianceFilterMode::Ggx ) {
+		plan->mGgxLobes = detail::createGgxLobes( dstFaceSize, plan->mMipCount, glm::max<uint32_t>( 1, options.mGgxSampleCount ) );
+		return plan;
+	}
+
+	// lobe of each output mip
+	for( uint8_t mip = 0; mip < plan->mMipCount; ++mip ) {
+		float specularPower = detail::getSpecularPower( mip, plan->mMipCount, options.mGlossScale, options.mGlossBias, options.mLightingModel );
+		plan->mSpecularPowers.push_back( specularPower );
+		plan->mFilterAngles.push_back( detail::getFilterAngle( specularPower ) );
+	}
+
+	// the native filter convolves each mip against the coarsest source level resolving its lobe, each level needs its own block layout
+	if( options.mBackend == ComputeBackend::NativeCpu ) {
+		plan->mSourceBlocks.resize( 1 );
+		for( uint8_t mip = options.mExcludeBase ? 1 : 0; mip < plan->mMipCount; ++mip ) {
+			uint8_t level = detail::getSourceLevel( dstFaceSize, mip, plan->mSpecularPowers[mip] );
+			plan->mSourceLevels[mip] = level;
+			if( plan->mSourceBlocks.size() <= level ) {
+				plan->mSourceBlocks.resize( level + 1 );
+			}
+			if( ! plan->mSourceBlocks[level] ) {
+				plan->mSourceBlocks[level] = detail::createSourceBlocks( glm::max( 1u, dstFaceSize >> level ) );
+			}
+		}
+		return plan;
+	}
+
+	// use the user provided opencl context or borrow one from the pool, a null context means cpu threads only
+	plan->mPooledClContext = ! options.mClContext || options.mBackend == ComputeBackend::Cpu;
+	if( plan->mPooledClContext ) {
+		plan->mClContext = acquireBackendClContext( options, &plan->mBackend );
+	}
+	else {
+		plan->mClContext = options.mClContext;
+		plan->mBackend = options.mBackend == ComputeBackend::OpenClGpu || options.mBackend == ComputeBackend::OpenClCpu ? options.mBackend : ComputeBackend::Auto;
+	}
+
+	return plan;
+}
+
+FilterPlanRef FilterPlan::create( uint32_t dstFaceSize, const IrradianceFilterOptions &options )
+{
+	StageTimer timer( BakeStage::Filter );
+	FilterPlanRef plan( new FilterPlan( dstFaceSize, false ) );
+	plan->mIrradianceOptions = options;
+	plan->mTable = detail::getCubemapTable( dstFaceSize );
+	return plan;
+}
+
+bool FilterPlan::execute( cmft::Image &input, cmft::Image &output )
+{
+	BakeStatsScope stats( "FilterPlan::execute" );
+	if( ! cmft::imageIsValid( input ) ) {
+		return false;
+	}
+
+	// prepare input
+	if( ! cmft::imageIsCubemap( input ) ) {
+		convertToCubemap( input );
+	}
+
+	return mRadiance ? executeRadiance( input, output ) : executeIrradiance( input, output );
+}
+
+ci::gl::TextureCubeMapRef FilterPlan::execute( cmft::Image &input )
+{
+	BakeStatsScope stats( "FilterPlan::execute" );
+
+	// generate output
+	cmft::Image output;
+	if( ! execute( input, output ) ) {
+		return ci::gl::TextureCubeMapRef();
 	}
-	
-	cmft::imageCubemapFromFaceList( output, faceList );
+
+	// generate the opengl cubemap texture
+	auto outputTex = createTextureCubemap( output );
+
+	// release image memory
+	unloadImage( output );
+
+	return outputTex;
 }
 
-void convertToCubemap( cmft::Image &image ) 
+bool FilterPlan::executeRadiance( cmft::Image &input, cmft::Image &output )
 {
-	if( ! cmft::imageIsCubemap( image ) ) {
-		if( cmft::imageIsCubeCross( image ) ) {
-			cmft::imageCubemapFromCross( image );
-		}
-		else if( cmft::imageIsLatLong( image ) ) {
-			cmft::imageCubemapFromLatLong( image );
+	const auto &options = mRadianceOptions;
+	if( input.m_width != mFaceSize ) {
+		StageTimer timer( BakeStage::Resize );
+		untrackImage( input );
+		cmft::imageResize( input, mFaceSize );
+		trackImage( input );
+	}
+
+	// apply the filter
+	{
+		StageTimer timer( BakeStage::Gamma );
+		cmft::imageApplyGamma( input, options.mGammaInput );
+	}
+	if( mGgxLobes || ! mSourceBlocks.empty() ) {
+		if( input.m_format != cmft::TextureFormat::RGBA32F ) {
+			StageTimer timer( BakeStage::Convert );
+			untrackImage( input );
+			cmft::imageConvert( input, cmft::TextureFormat::RGBA32F );
+			trackImage( input );
 		}
-		else if( cmft::imageIsHStrip( image ) || cmft::imageIsVStrip( image ) )	{
-			cmft::imageCubemapFromStrip( image );
+	}
+
+	bool filtered = true;
+	{
+		FilterTimer timer( mBackend, options.mNumCpuProcessingThreads );
+		if( mGgxLobes ) {
+			detail::ggxFilter( output, input, *mGgxLobes, options.mNumCpuProcessingThreads );
 		}
-		else if( cmft::imageIsOctant( image ) )	{
-			cmft::imageCubemapFromOctant( image );
+		else if( ! mSourceBlocks.empty() ) {
+			detail::SourcePyramid pyramid;
+			detail::buildSourcePyramid( pyramid, input, options.mNumCpuProcessingThreads );
+			detail::radianceFilter( output, pyramid, mSourceBlocks, mSourceLevels.data(), mSpecularPowers.data(), mFilterAngles.data(), mMipCount, options.mExcludeBase, options.mEdgeFixup == EdgeFixup::Warp, options.mNumCpuProcessingThreads );
 		}
-		else if( ! cmft::imageCubemapFromCross( image ) ) {
-			app::console() << "problem converting!!!!" << endl;
+		else {
+			filtered = cmft::imageRadianceFilter( output, mFaceSize, options.mLightingModel, options.mExcludeBase, mMipCount, options.mGlossScale, options.mGlossBias, input, options.mEdgeFixup, options.mNumCpuProcessingThreads, mClContext );
 		}
 	}
-}
-
-ci::gl::TextureCubeMapRef createTextureCubemap( cmft::Image &image )
-{
-	// Input check.
-    if( ! imageIsCubemap( image ) ) {
-        convertToCubemap( image );
-    }
-
-    // Get destination sizes and offsets.
-    uint32_t dstDataSize = 0;
-    uint32_t dstMipOffsets[MAX_MIP_NUM];
-    const uint8_t bytesPerPixel = cmft::getImageDataInfo( image.m_format ).m_bytesPerPixel;
-    for( uint8_t mip = 0; mip < image.m_numMips; ++mip ) {
-        dstMipOffsets[mip] = dstDataSize;
-        const uint32_t mipSize = glm::max( UINT32_C(1), image.m_width >> mip );
-        dstDataSize += mipSize * mipSize * bytesPerPixel;
-    }
+	trackImage( output );
 
-    // Get source offsets.
-    uint32_t cubemapOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-    cmft::imageGetMipOffsets( cubemapOffsets, image );
-
-	// create opengl texture
-	GLenum format = GL_RGB, dataType = GL_UNSIGNED_BYTE;
-	auto texFormat = gl::TextureCubeMap::Format();
-	switch( image.m_format ) {
-	case cmft::TextureFormat::BGR8:
-		format = GL_BGR;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat.setInternalFormat( GL_BGR );
-		break;
-	case cmft::TextureFormat::RGB8:
-		format = GL_RGB;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat.setInternalFormat( GL_RGB8 );
-		break;
-	case cmft::TextureFormat::RGB16:
-		format = GL_RGB;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat.setInternalFormat( GL_RGB16 );
-		break;
-	case cmft::TextureFormat::RGB16F:
-		format = GL_RGB;
-		dataType = GL_HALF_FLOAT;
-		texFormat.setInternalFormat( GL_RGB16F );
-		break;
-	case cmft::TextureFormat::RGB32F:
-		format = GL_RGB;
-		dataType = GL_FLOAT;
-		texFormat.setInternalFormat( GL_RGB32F );
-		break;
-	case cmft::TextureFormat::BGRA8:
-		format = GL_BGRA;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat.setInternalFormat( GL_BGRA );
-		break;
-	case cmft::TextureFormat::RGBA8:
-		format = GL_RGBA;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat.setInternalFormat( GL_RGBA8 );
-		break;
-	case cmft::TextureFormat::RGBA16:
-		format = GL_RGBA;
-		dataType = GL_UNSIGNED_BYTE;
-		texFormat.setInternalFormat( GL_RGBA16 );
-		break;
-	case cmft::TextureFormat::RGBA16F:
-		format = GL_RGBA;
-		dataType = GL_HALF_FLOAT;
-		texFormat.setInternalFormat( GL_RGBA16F );
-		break;
-	case cmft::TextureFormat::RGBA32F:
-		format = GL_RGBA;
-		dataType = GL_FLOAT;
-		texFormat.setInternalFormat( GL_RGBA32F );
-		break;
-	}
-	if( image.m_numMips > 1 ) {
-		texFormat.enableMipmapping();
-		texFormat.setBaseMipmapLevel( 0 );
-		texFormat.setMaxMipmapLevel( image.m_numMips );
-	}
-	
-	auto cubemap = gl::TextureCubeMap::create( image.m_width, image.m_height, texFormat );
-	gl::ScopedTextureBind scopedTexBind( cubemap );
-	glGenerateMipmap( GL_TEXTURE_CUBE_MAP );
-	glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
-		
-	glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, image.m_numMips );		
-       
-	for( uint8_t face = 0; face < 6; ++face ) {
-		for( uint8_t mip = 0; mip < image.m_numMips; ++mip ) {
-			const uint32_t mipFaceSize = glm::max( UINT32_C(1), image.m_width >> mip);    
-			GLvoid* pixels = (GLvoid*) ( (uint8_t*) image.m_data + cubemapOffsets[face][mip] );
-			glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, texFormat.getInternalFormat(), mipFaceSize, mipFaceSize, 0, format, dataType, pixels );
-		}
-    }
+	StageTimer timer( BakeStage::Gamma );
+	cmft::imageApplyGamma( output, options.mGammaOutput );
 
-	return cubemap;
+	return filtered;
 }
 
-ci::gl::TextureCubeMapRef createTextureCubemap( const ci::fs::path &filePath )
+bool FilterPlan::executeIrradiance( cmft::Image &input, cmft::Image &output )
 {
-	cmft::Image input;
-	bool imageLoaded = cmft::imageLoad( input, filePath.string().c_str(), cmft::TextureFormat::RGBA32F )
-					|| cmft::imageLoadStb( input, filePath.string().c_str(), cmft::TextureFormat::RGBA32F );
-	
-	if( ! imageLoaded ) {
-		app::console() << "Problem loading Image" << endl;
+	// the irradiance is smooth enough to be fully described by its spherical harmonics
+	ShCoeffs coeffs;
+	if( ! createIemSh( input, coeffs, mIrradianceOptions ) ) {
+		return false;
 	}
 
-	return createTextureCubemap( input );
-}
+	// evaluate them back into a cubemap
+	{
+		StageTimer timer( BakeStage::Sh );
+		detail::evaluateSh( output, *mTable, &coeffs[0].x );
+		trackImage( output );
+	}
+	StageTimer timer( BakeStage::Gamma );
+	cmft::imageApplyGamma( output, mIrradianceOptions.mGammaOutput );
 
+	return true;
+}
 
-RadianceFilterOptions& RadianceFilterOptions::gammaCorrection( float gammaInput, float gammaOutput )
+EnvironmentOptions& EnvironmentOptions::skybox( bool enabled )
 {
-	mGammaInput = gammaInput;
-	mGammaOutput = gammaOutput;
+	mSkybox = enabled;
 	return *this;
 }
-RadianceFilterOptions& RadianceFilterOptions::lightingModel( LightingModel::Enum model )
+EnvironmentOptions& EnvironmentOptions::pmrem( uint32_t faceSize, const RadianceFilterOptions &options )
 {
-	mLightingModel = model;
+	mPmremSize = faceSize;
+	mPmremOptions = options;
 	return *this;
 }
-RadianceFilterOptions& RadianceFilterOptions::edgeFixup( EdgeFixup::Enum fixup )
+EnvironmentOptions& EnvironmentOptions::iem( uint32_t faceSize, const IrradianceFilterOptions &options )
 {
-	mEdgeFixup = fixup;
+	mIemSize = faceSize;
+	mIemOptions = options;
 	return *this;
 }
-RadianceFilterOptions& RadianceFilterOptions::mipCount( uint8_t mips )
+EnvironmentOptions& EnvironmentOptions::cache( bool enabled )
 {
-	mMipCount = mips;
+	mCacheEnabled = enabled;
 	return *this;
 }
-RadianceFilterOptions& RadianceFilterOptions::glossScale( uint8_t scale )
+EnvironmentOptions& EnvironmentOptions::cacheSkybox( bool enabled )
 {
-	mGlossScale = scale;
+	mCacheSkybox = enabled;
 	return *this;
 }
-RadianceFilterOptions& RadianceFilterOptions::glossBias( uint8_t bias )
+
+bool isEnvironmentSetCached( const ci::fs::path &filePath, const EnvironmentOptions &options )
 {
-	mGlossBias = bias;
-	return *this;
+	if( ! options.mCacheEnabled || ! fs::exists( filePath ) ) {
+		return false;
+	}
+
+	auto sourceHash = hashSourceFile( filePath );
+	auto isCached = []( const ci::fs::path &cachePath ) { return fs::exists( cachePath.string() + ".dds" ); };
+	return ( ! options.mSkybox || ( options.mCacheSkybox && isCached( getEmCachePath( filePath, sourceHash ) ) ) )
+		&& ( ! options.mPmremSize || isCached( getPmremCachePath( filePath, sourceHash, options.mPmremSize, options.mPmremOptions ) ) )
+		&& ( ! options.mIemSize || isCached( getIemCachePath( filePath, sourceHash, options.mIemSize, options.mIemOptions ) ) );
 }
-RadianceFilterOptions& RadianceFilterOptions::numCpuProcessingThreads( uint8_t numThreads )
+
+std::vector<ci::fs::path> getEnvironmentSetCachePaths( const ci::fs::path &filePath, const EnvironmentOptions &options )
 {
-	mNumCpuProcessingThreads = numThreads;
-	return *this;
+	std::vector<ci::fs::path> paths;
+	if( ! options.mCacheEnabled ) {
+		return paths;
+	}
+	auto sourceHash = hashSourceFile( filePath );
+	if( options.mSkybox && options.mCacheSkybox ) {
+		paths.push_back( getEmCachePath( filePath, sourceHash ).string() + ".dds" );
+	}
+	if( options.mPmremSize ) {
+		paths.push_back( getPmremCachePath( filePath, sourceHash, options.mPmremSize, options.mPmremOptions ).string() + ".dds" );
+	}
+	if( options.mIemSize ) {
+		paths.push_back( getIemCachePath( filePath, sourceHash, options.mIemSize, options.mIemOptions ).string() + ".dds" );
+	}
+	return paths;
 }
-RadianceFilterOptions& RadianceFilterOptions::excludeBase( bool exclude )
+
+size_t pruneCache( const ci::fs::path &filePath, const std::vector<ci::fs::path> &keep )
 {
-	mExcludeBase = exclude;
-	return *this;
+	auto directory = getCacheDirectory();
+	if( directory.empty() ) {
+		directory = filePath.parent_path();
+	}
+
+	// the prefixes are matched exactly so that sources sharing the beginning of their name are left alone
+	const auto stem = filePath.filename().stem().string();
+	size_t numRemoved = 0;
+	try {
+		std::vector<ci::fs::path> stale;
+		for( fs::directory_iterator it( directory.empty() ? ci::fs::path( "." ) : directory ), end; it != end; ++it ) {
+			bool kept = std::any_of( keep.begin(), keep.end(), [&it]( const ci::fs::path &path ) { return path.filename() == it->path().filename(); } );
+			for( auto suffix : { "_em_", "_pmrem_", "_iem_" } ) {
+				if( ! kept && isKeyedCacheFile( it->path(), stem + suffix ) ) {
+					stale.push_back( it->path() );
+					break;
+				}
+			}
+		}
+		for( const auto &path : stale ) {
+			fs::remove( path );
+			++numRemoved;
+		}
+	}
+	catch( const std::exception & ) {
+	}
+	return numRemoved;
 }
 
 namespace {
-	void loadCl()
+	// bakes what the cache doesn't hold yet, \a sourceHash being the hash of the source file when caching is enabled
+	bool createEnvironmentSet( const ci::fs::path &filePath, uint64_t sourceHash, cmft::Image &em, cmft::Image &pmrem, cmft::Image &iem, const EnvironmentOptions &options )
 	{
-		static bool loaded = false;
-		if( ! loaded ) {
-			bx::clLoad();
-			cmft::clPrintDevices();
-			app::App::get()->getSignalCleanup().connect( []() {
-				bx::clUnload();
-			} );
-			loaded = true;
+		// filtered outputs already in the cache don't need the source image
+		auto pmremCachePath = getPmremCachePath( filePath, sourceHash, options.mPmremSize, options.mPmremOptions );
+		auto iemCachePath = getIemCachePath( filePath, sourceHash, options.mIemSize, options.mIemOptions );
+		auto emCachePath = getEmCachePath( filePath, sourceHash );
+		bool cacheEm = options.mCacheEnabled && options.mCacheSkybox;
+		bool needsPmrem = options.mPmremSize && ! ( options.mCacheEnabled && loadCachedImage( pmremCachePath, pmrem ) );
+		bool needsIem = options.mIemSize && ! ( options.mCacheEnabled && loadCachedImage( iemCachePath, iem ) );
+		bool needsEm = options.mSkybox && ! ( cacheEm && loadCachedImage( emCachePath, em ) );
+		if( ! needsEm && ! needsPmrem && ! needsIem ) {
+			return true;
+		}
+
+		// decode and convert the source a single time
+		cmft::Image source;
+		if( ! loadSourceImage( filePath, source ) ) {
+			return false;
 		}
+		convertToCubemap( source );
+
+		bool succeeded = true;
+
+		// the irradiance filter only modifies its input when applying gamma
+		if( needsIem ) {
+			if( options.mIemOptions.mGammaInput != 1.0f ) {
+				cmft::Image input;
+				cmft::imageCopy( input, source );
+				trackImage( input );
+				succeeded &= createIem( input, iem, options.mIemSize, options.mIemOptions );
+				unloadImage( input );
+			}
+			else {
+				succeeded &= createIem( source, iem, options.mIemSize, options.mIemOptions );
+			}
+			if( succeeded && options.mCacheEnabled ) {
+				saveCachedImage( iemCachePath, iem, filePath );
+			}
+		}
+
+		// the radiance filter resizes its input in place, only copy the source when the skybox still needs it
+		if( needsEm ) {
+			if( needsPmrem ) {
+				cmft::imageCopy( em, source );
+				trackImage( em );
+			}
+			else {
+				cmft::imageMove( em, source );
+			}
+			if( cacheEm ) {
+				saveCachedImage( emCachePath, em, filePath );
+			}
+		}
+		if( needsPmrem ) {
+			bool filtered = createPmrem( source, pmrem, options.mPmremSize, options.mPmremOptions );
+			if( filtered && options.mCacheEnabled ) {
+				saveCachedImage( pmremCachePath, pmrem, filePath );
+			}
+			succeeded &= filtered;
+		}
+	
+		// release image memory
+		if( cmft::imageIsValid( source ) ) {
+			unloadImage( source );
+		}
+
+		return succeeded;
 	}
 }
 
-bool createPmrem( cmft::Image &input, cmft::Image &output, uint32_t dstFaceSize, const RadianceFilterOptions &options )
+bool createEnvironmentSet( const ci::fs::path &filePath, cmft::Image &em, cmft::Image &pmrem, cmft::Image &iem, const EnvironmentOptions &options )
 {
-	// prepare input / output
-	if( ! cmft::imageIsCubemap( input ) ) {
-		convertToCubemap( input );
-	}
-	cmft::imageCreate( output, dstFaceSize, dstFaceSize, 0xff0000ff, 7, 6, cmft::TextureFormat::RGBA32F );
+	BakeStatsScope stats( "createEnvironmentSet", filePath );
+	return createEnvironmentSet( filePath, options.mCacheEnabled ? hashSourceFile( filePath ) : 0, em, pmrem, iem, options );
+}
 
-	// create the opencl context
-	auto clContext = make_unique<cmft::ClContext>();
-	loadCl();
-	clContext->init( CMFT_CL_VENDOR_ANY_GPU, CMFT_CL_DEVICE_TYPE_GPU );
+EnvironmentSet createEnvironmentSet( const ci::fs::path &filePath, const EnvironmentOptions &options )
+{
+	BakeStatsScope stats( "createEnvironmentSet", filePath );
+	EnvironmentSet set;
 
-	if( input.m_width != dstFaceSize ) {
-		cmft::imageResize( input, dstFaceSize );
+	// upload cached results straight from the files and only bake what's left
+	EnvironmentOptions remaining = options;
+	auto sourceHash = options.mCacheEnabled ? hashSourceFile( filePath ) : 0;
+	if( options.mCacheEnabled ) {
+		if( options.mPmremSize && ( set.mPmrem = createTextureCubemapFromCache( getPmremCachePath( filePath, sourceHash, options.mPmremSize, options.mPmremOptions ) ) ) ) {
+			remaining.mPmremSize = 0;
+		}
+		if( options.mIemSize && ( set.mIem = createTextureCubemapFromCache( getIemCachePath( filePath, sourceHash, options.mIemSize, options.mIemOptions ) ) ) ) {
+			remaining.mIemSize = 0;
+		}
+		if( options.mSkybox && options.mCacheSkybox && ( set.mEm = createTextureCubemapFromCache( getEmCachePath( filePath, sourceHash ) ) ) ) {
+			remaining.mSkybox = false;
+		}
 	}
 
-	// apply the filter
-	cmft::imageApplyGamma( input, options.mGammaInput );
-	cmft::imageRadianceFilter( output, dstFaceSize, cmft::LightingModel::BlinnBrdf, options.mExcludeBase, options.mMipCount, options.mGlossScale, options.mGlossBias, input, options.mEdgeFixup, options.mNumCpuProcessingThreads, clContext.get() );
-	cmft::imageApplyGamma( output, options.mGammaOutput );
-		
-	// Release OpenCL context and image memory
-	clContext->destroy();
-	clContext.reset();
+	cmft::Image em, pmrem, iem;
+	createEnvironmentSet( filePath, sourceHash, em, pmrem, iem, remaining );
+
+	// generate the opengl cubemap textures and release image memory
+	for( auto output : { make_pair( &em, &set.mEm ), make_pair( &pmrem, &set.mPmrem ), make_pair( &iem, &set.mIem ) } ) {
+		if( cmft::imageIsValid( *output.first ) ) {
+			*output.second = createTextureCubemap( *output.first );
+			unloadImage( *output.first );
+		}
+	}
 
-	return true;//filtered;
+	return set;
 }
-gl::TextureCubeMapRef createPmrem( cmft::Image &input, uint32_t dstFaceSize, const RadianceFilterOptions &options )
-{
-	// prepare and generate output
-	cmft::Image output;	
-	createPmrem( input, output, dstFaceSize, options );
 
-	// generate the opengl cubemap texture
-	auto outputTex = createTextureCubemap( output );
+namespace {
+	// small fixed size thread pool running the asynchronous bakes
+	class WorkerPool {
+	public:
+		WorkerPool( size_t numThreads ) : mStopped( false )
+		{
+			for( size_t i = 0; i < numThreads; ++i ) {
+				mThreads.emplace_back( [this]() {
+					while( true ) {
+						function<void()> task;
+						{
+							unique_lock<mutex> lock( mMutex );
+							mCondition.wait( lock, [this]() { return mStopped || ! mTasks.empty(); } );
+							if( mStopped ) {
+								return;
+							}
+							task = std::move( mTasks.front() );
+							mTasks.pop_front();
+						}
+						detail::setTraceThreadName( "cmft async" );
+						task();
+					}
+				} );
+			}
+		}
+		~WorkerPool()
+		{
+			stop();
+		}
 
-	// release image memory
-	cmft::imageUnload( output );
+		//! Drops the pending tasks, breaking their promises, and waits for the running ones
+		void stop()
+		{
+			std::deque<function<void()>> pending;
+			{
+				lock_guard<mutex> lock( mMutex );
+				mStopped = true;
+				pending.swap( mTasks );
+			}
+			mCondition.notify_all();
+			for( auto &thread : mThreads ) {
+				if( thread.joinable() ) {
+					thread.join();
+				}
+			}
+		}
 
-	return outputTex;
-}
+		template<typename Func>
+		std::shared_future<bool> enqueue( Func &&func )
+		{
+			auto task = make_shared<packaged_task<bool()>>( std::forward<Func>( func ) );
+			std::shared_future<bool> future = task->get_future().share();
+			{
+				// a task enqueued after stop() is dropped, its future reports a failure
+				lock_guard<mutex> lock( mMutex );
+				if( mStopped ) {
+					return future;
+				}
+				mTasks.push_back( [task]() { (*task)(); } );
+			}
+			mCondition.notify_one();
+			return future;
+		}
 
-ci::gl::TextureCubeMapRef createPmrem( const ci::Surface &source, uint32_t dstFaceSize, const RadianceFilterOptions &options )
-{
-	cmft::Image input;
-	surfaceToImage( source, input );
-	
-	// generate the opengl cubemap texture
-	auto outputTex = createPmrem( input, dstFaceSize, options );
-	
-	// Release output image memory
-	cmft::imageUnload( input );
+	protected:
+		bool						mStopped;
+		std::mutex					mMutex;
+		std::condition_variable		mCondition;
+		std::deque<function<void()>> mTasks;
+		std::vector<std::thread>	mThreads;
+	};
 
-	return outputTex;
-}
-ci::gl::TextureCubeMapRef createPmrem( const ci::fs::path &filePath, uint32_t dstFaceSize, const RadianceFilterOptions &options, bool cacheEnabled )
-{
-	cmft::Image output;
+	// set once the pool exists, so that the cleanup doesn't create it
+	std::atomic<WorkerPool*> sWorkerPool( nullptr );
 
-	// if caching is enabled check whether the results have already been calculated
-	auto cachePath = filePath.parent_path() / ( filePath.filename().stem().string() + "_pmrem.dds" );
-	if( cacheEnabled && fs::exists( cachePath ) && 
-		( cmft::imageLoad( output, cachePath.string().c_str(), cmft::TextureFormat::RGBA32F )
-		|| cmft::imageLoadStb( output, cachePath.string().c_str(), cmft::TextureFormat::RGBA32F ) ) ) {
+	WorkerPool& getWorkerPool()
+	{
+		// bakes are already multithreaded, two workers are enough to overlap io and filtering
+		static WorkerPool pool( 2 );
+		sWorkerPool = &pool;
+		connectAppCleanup();
+		return pool;
 	}
-	// otherwise load the original file and apply the radiance filter
-	else {
-		cmft::Image input;
-		bool imageLoaded = cmft::imageLoad( input, filePath.string().c_str(), cmft::TextureFormat::RGBA32F )
-						|| cmft::imageLoadStb( input, filePath.string().c_str(), cmft::TextureFormat::RGBA32F );
-	
-		if( ! imageLoaded ) {
-			app::console() << "Problem loading Image" << endl;
-		}
-		
-		createPmrem( input, output, dstFaceSize, options );
-		cmft::imageUnload( input );
-		
-		// save results if caching is enabled
-		if( cacheEnabled ) {
-			auto cachePath = filePath.parent_path() / ( filePath.filename().stem().string() + "_pmrem" );
-			cmft::imageSave( output, cachePath.string().c_str(), ImageFileType::DDS, OutputType::Cubemap, TextureFormat::RGBA16F, true );
+
+	// stops the workers on app cleanup rather than during static destruction
+	void stopWorkerPool()
+	{
+		if( auto pool = sWorkerPool.load() ) {
+			pool->stop();
 		}
 	}
-	
-	// generate the opengl cubemap texture
-	auto outputTex = createTextureCubemap( output ); 
-	
-	// Release output image memory
-	cmft::imageUnload( output );
-	
-	return outputTex;
-}
-
-IrradianceFilterOptions& IrradianceFilterOptions::gammaCorrection( float gammaInput, float gammaOutput )
-{
-	mGammaInput = gammaInput;
-	mGammaOutput = gammaOutput;
-	return *this;
-}
 
-bool createIem( cmft::Image &input, cmft::Image &output, uint32_t dstFaceSize, const IrradianceFilterOptions &options )
-{	
-	// prepare input / output
-	if( ! cmft::imageIsCubemap( input ) ) {
-		convertToCubemap( input );
+	// a dropped task breaks its promise, reported as a failed bake
+	bool getFutureResult( const std::shared_future<bool> &future )
+	{
+		try {
+			return future.get();
+		}
+		catch( const std::future_error & ) {
+			return false;
+		}
 	}
-	cmft::imageCreate( output, dstFaceSize, dstFaceSize, 0xff0000ff, 1, 6, cmft::TextureFormat::RGB32F );
 
-	// apply the filter
-	cmft::imageApplyGamma( input, options.mGammaInput );
-	bool filtered = cmft::imageIrradianceFilterSh( output, dstFaceSize, input );
-	cmft::imageApplyGamma( output, options.mGammaOutput );
+	// owns the image shared between the worker task and the handle
+	shared_ptr<cmft::Image> makeSharedImage()
+	{
+		return shared_ptr<cmft::Image>( new cmft::Image(), []( cmft::Image *image ) {
+			if( cmft::imageIsValid( *image ) ) {
+				cmft::imageUnload( *image );
+			}
+			delete image;
+		} );
+	}
 
-	return filtered;
+	shared_ptr<cmft::Image> copySharedImage( const cmft::Image &input )
+	{
+		auto image = makeSharedImage();
+		cmft::imageCopy( *image, input );
+		return image;
+	}
 }
-ci::gl::TextureCubeMapRef createIem( cmft::Image &input, uint32_t dstFaceSize, const IrradianceFilterOptions &options )
-{	
-	// generate output
-	cmft::Image output;
-	createIem( input, output, dstFaceSize, options );
-
-	// generate the opengl cubemap texture
-	auto outputTex = createTextureCubemap( output );
-
-	// release image memory
-	cmft::imageUnload( output );
 
-	return outputTex;
+AsyncTextureCubeMap::AsyncTextureCubeMap( const std::shared_future<bool> &future, const std::shared_ptr<cmft::Image> &image, const char *function, const ci::fs::path &source )
+: mFuture( future ), mImage( image ), mFunction( function ), mSource( source )
+{
 }
 
-ci::gl::TextureCubeMapRef createIem( const ci::Surface &source, uint32_t dstFaceSize, const IrradianceFilterOptions &options )
+bool AsyncTextureCubeMap::isReady() const
 {
-	cmft::Image input;
-	surfaceToImage( source, input );
+	return mFuture.wait_for( chrono::seconds( 0 ) ) == future_status::ready;
+}
 
-	// generate the opengl cubemap texture
-	auto outputTex = createIem( input, dstFaceSize, options );
+void AsyncTextureCubeMap::wait() const
+{
+	mFuture.wait();
+}
 
-	// release image memory
-	cmft::imageUnload( input );
-	
-	return outputTex;
+bool AsyncTextureCubeMap::succeeded() const
+{
+	return isReady() && getFutureResult( mFuture );
 }
 
-ci::gl::TextureCubeMapRef createIem( const ci::fs::path &filePath, uint32_t dstFaceSize, const IrradianceFilterOptions &options, bool cacheEnabled )
+ci::gl::TextureCubeMapRef AsyncTextureCubeMap::getTexture()
 {
-	cmft::Image output;
-	
-	// if caching is enabled check whether the results have already been calculated
-	auto cachePath = filePath.parent_path() / ( filePath.filename().stem().string() + "_iem.dds" );
-	if( cacheEnabled && fs::exists( cachePath ) && 
-		( cmft::imageLoad( output, cachePath.string().c_str(), cmft::TextureFormat::RGBA32F )
-		|| cmft::imageLoadStb( output, cachePath.string().c_str(), cmft::TextureFormat::RGBA32F ) ) ) {
+	if( ! mTexture && mImage && isReady() ) {
+		if( getFutureResult( mFuture ) && cmft::imageIsValid( *mImage ) ) {
+			// the filtering was reported by the worker thread, this reports the upload under the async call name
+			BakeStatsScope stats( mFunction, mSource );
+			mTexture = createTextureCubemap( *mImage );
+		}
+		// the cpu copy isn't needed anymore
+		mImage.reset();
 	}
-	// otherwise load the original file and apply the radiance filter
-	else {
-		cmft::Image input;
-		bool imageLoaded = cmft::imageLoad( input, filePath.string().c_str(), cmft::TextureFormat::RGBA32F )
-						|| cmft::imageLoadStb( input, filePath.string().c_str(), cmft::TextureFormat::RGBA32F );
-	
-		if( ! imageLoaded ) {
-			app::console() << "Problem loading Image" << endl;
+	return mTexture;
+}
+
+AsyncTextureCubeMapRef createTextureCubemapAsync( const cmft::Image &image )
+{
+	auto input = copySharedImage( image );
+	auto future = getWorkerPool().enqueue( [input]() {
+		convertToCubemap( *input );
+		return cmft::imageIsCubemap( *input );
+	} );
+	return AsyncTextureCubeMapRef( new AsyncTextureCubeMap( future, input ) );
+}
+AsyncTextureCubeMapRef createTextureCubemapAsync( const ci::fs::path &filePath )
+{
+	auto input = makeSharedImage();
+	auto future = getWorkerPool().enqueue( [input, filePath]() {
+		if( ! loadSourceImage( filePath, *input ) ) {
+			return false;
 		}
+		convertToCubemap( *input );
+		return cmft::imageIsCubemap( *input );
+	} );
+	return AsyncTextureCubeMapRef( new AsyncTextureCubeMap( future, input, "createTextureCubemapAsync", filePath ) );
+}
 
-		createIem( input, output, dstFaceSize, options );
+AsyncTextureCubeMapRef createPmremAsync( const cmft::Image &input, uint32_t dstFaceSize, const RadianceFilterOptions &options )
+{
+	auto inputCopy = copySharedImage( input );
+	auto output = makeSharedImage();
+	auto future = getWorkerPool().enqueue( [inputCopy, output, dstFaceSize, options]() {
+		return createPmrem( *inputCopy, *output, dstFaceSize, options );
+	} );
+	return AsyncTextureCubeMapRef( new AsyncTextureCubeMap( future, output, "createPmremAsync" ) );
+}
+AsyncTextureCubeMapRef createPmremAsync( const ci::fs::path &filePath, uint32_t dstFaceSize, const RadianceFilterOptions &options, bool cacheEnabled )
+{
+	auto output = makeSharedImage();
+	auto future = getWorkerPool().enqueue( [filePath, output, dstFaceSize, options, cacheEnabled]() {
+		return createPmrem( filePath, *output, dstFaceSize, options, cacheEnabled );
+	} );
+	return AsyncTextureCubeMapRef( new AsyncTextureCubeMap( future, output, "createPmremAsync", filePath ) );
+}
 
-		// save results if caching is enabled
-		if( cacheEnabled ) {
-			auto cachePath = filePath.parent_path() / ( filePath.filename().stem().string() + "_iem" );
-			cmft::imageSave( output, cachePath.string().c_str(), ImageFileType::DDS, OutputType::Cubemap, TextureFormat::RGBA16F, true );
-		}
+AsyncEnvironmentSet createEnvironmentSetAsync( const ci::fs::path &filePath, const EnvironmentOptions &options )
+{
+	// the three handles share the same worker task
+	auto em = makeSharedImage();
+	auto pmrem = makeSharedImage();
+	auto iem = makeSharedImage();
+	auto future = getWorkerPool().enqueue( [filePath, em, pmrem, iem, options]() {
+		return createEnvironmentSet( filePath, *em, *pmrem, *iem, options );
+	} );
 
-		// release image memory
-		cmft::imageUnload( input );
-	}
-	
-	auto outputTex = createTextureCubemap( output );
+	AsyncEnvironmentSet set;
+	set.mEm = AsyncTextureCubeMapRef( new AsyncTextureCubeMap( future, em, "createEnvironmentSetAsync", filePath ) );
+	set.mPmrem = AsyncTextureCubeMapRef( new AsyncTextureCubeMap( future, pmrem, "createEnvironmentSetAsync", filePath ) );
+	set.mIem = AsyncTextureCubeMapRef( new AsyncTextureCubeMap( future, iem, "createEnvironmentSetAsync", filePath ) );
+	return set;
+}
 
-	// release image memory
-	cmft::imageUnload( output );
-	
-	return outputTex;
+AsyncTextureCubeMapRef createIemAsync( const cmft::Image &input, uint32_t dstFaceSize, const IrradianceFilterOptions &options )
+{
+	auto inputCopy = copySharedImage( input );
+	auto output = makeSharedImage();
+	auto future = getWorkerPool().enqueue( [inputCopy, output, dstFaceSize, options]() {
+		return createIem( *inputCopy, *output, dstFaceSize, options );
+	} );
+	return AsyncTextureCubeMapRef( new AsyncTextureCubeMap( future, output, "createIemAsync" ) );
+}
+AsyncTextureCubeMapRef createIemAsync( const ci::fs::path &filePath, uint32_t dstFaceSize, const IrradianceFilterOptions &options, bool cacheEnabled )
+{
+	auto output = makeSharedImage();
+	auto future = getWorkerPool().enqueue( [filePath, output, dstFaceSize, options, cacheEnabled]() {
+		return createIem( filePath, *output, dstFaceSize, options, cacheEnabled );
+	} );
+	return AsyncTextureCubeMapRef( new AsyncTextureCubeMap( future, output, "createIemAsync", filePath ) );
 }
 
 namespace {
-	int uglyCPrintFunc( const char* format, ... ) {
+	// cmft print functions, the messages are formatted straight into the logger queue
+	int logCmftWarning( const char* format, ... )
+	{
+		va_list args;
+		va_start( args, format );
+		logMessageV( LogLevel::Warning, format, args );
+		va_end( args );
+		return 1;
+	}
+
+	int logCmftInfo( const char* format, ... )
+	{
 		va_list args;
-		va_start(args, format);
-		va_list args2;
-		va_copy(args2, args);
-		std::vector<char> buf( 1 + std::vsnprintf( nullptr, 0, format, args ) );
+		va_start( args, format );
+		logMessageV( LogLevel::Info, format, args );
 		va_end( args );
-		std::vsnprintf( buf.data(), buf.size(), format, args2 );
-		string output = string( buf.begin(), buf.end() );
-		app::console() << output << endl;
-		va_end(args2);
 		return 1;
 	}
 } // anonymous namespace
 
 void connectConsole( bool warning, bool info )
 {
+	// written from the logger thread, falling back to std::cerr once the app is gone
+	setLogSink( []( LogLevel::Enum level, const char *message ) {
+		if( app::App::get() ) {
+			app::console() << "cmft " << getLogLevelName( level ) << ": " << message << endl;
+		}
+		else {
+			cerr << "cmft " << getLogLevelName( level ) << ": " << message << endl;
+		}
+	} );
+
 	if( warning ) {
-		cmft::setWarningPrintf( &uglyCPrintFunc );
+		cmft::setWarningPrintf( &logCmftWarning );
 	}
 	
 	if( info ) {
-		cmft::setInfoPrintf( &uglyCPrintFunc );	
+		cmft::setInfoPrintf( &logCmftInfo );
 	}
 }
 
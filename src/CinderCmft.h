@@ -2,14 +2,49 @@
 
 #include "cmft/image.h"
 #include "cmft/cubemapfilter.h"
+#include "cmft/clcontext.h"
+#include "CinderCmftLog.h"
+#include "CinderCmftTrace.h"
 #include "cinder/gl/Texture.h"
+#include "cinder/gl/Pbo.h"
+
+#include <array>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
 
 namespace cmft {
 
 //! Converts a ci::Surface \a surface to a cmft::Image
 void surfaceToImage( const ci::Surface &surface, cmft::Image &output );
-//! Converts a ci::gl::TextureCubeMap \a surface to a cmft::Image
-void textureCubemapToImage( const ci::gl::TextureCubeMapRef &cubemap, cmft::Image &output );
+//! Converts a ci::gl::TextureCubeMap \a cubemap to a cmft::Image, optionally converted to \a format. Blocks until the gpu is done
+void textureCubemapToImage( const ci::gl::TextureCubeMapRef &cubemap, cmft::Image &output, cmft::TextureFormat::Enum format = cmft::TextureFormat::Null );
+
+typedef std::shared_ptr<class CubemapReadback> CubemapReadbackRef;
+
+//! Non-blocking read back of a ci::gl::TextureCubeMap to a cmft::Image through a pixel buffer
+class CubemapReadback {
+public:
+	//! Issues the read back of the first level of \a cubemap. A \a format other than TextureFormat::Null converts on the gpu, ie. RGBA16F to halve the bandwidth
+	static CubemapReadbackRef create( const ci::gl::TextureCubeMapRef &cubemap, cmft::TextureFormat::Enum format = cmft::TextureFormat::Null );
+	~CubemapReadback();
+
+	//! Returns false if the format can't be read back, the readback never completes in that case
+	bool isValid() const { return mPbo != nullptr; }
+	//! Returns whether the gpu is done with the copy, never blocks. Always false for an invalid readback
+	bool isReady();
+	//! Copies the result to \a output. Returns false if the readback is invalid, the copy isn't done yet unless \a wait is true or the pixel buffer can't be mapped, \a output is left empty in the last case
+	bool getImage( cmft::Image &output, bool wait = false );
+
+protected:
+	CubemapReadback( const ci::gl::TextureCubeMapRef &cubemap, cmft::TextureFormat::Enum format );
+
+	uint32_t					mFaceSize;
+	cmft::TextureFormat::Enum	mFormat;
+	ci::gl::PboRef				mPbo;
+	GLsync						mFence;
+};
 //! Converts a cmft::Image \a image to a Cubemap cmft::Image
 void convertToCubemap( cmft::Image &image );
 
@@ -18,8 +53,50 @@ ci::gl::TextureCubeMapRef	createTextureCubemap( cmft::Image &image );
 //! Creates a ci::gl::TextureCubeMapRef from an image at \a filePath
 ci::gl::TextureCubeMapRef	createTextureCubemap( const ci::fs::path &filePath );
 
+//! How source files are identified in the cache keys
+struct SourceHash {
+	enum Enum {
+		SizeAndTime,	//! file size and last write time, no file read
+		Content			//! file size and hash of the whole file content
+	};
+};
+
+//! Sets the directory where filtered results are cached. An empty path, the default, caches next to the source files
+void			setCacheDirectory( const ci::fs::path &directory );
+//! Returns the directory where filtered results are cached
+ci::fs::path	getCacheDirectory();
+//! Sets how the source files are identified in the cache keys. Defaults to SourceHash::SizeAndTime
+void			setCacheSourceHash( SourceHash::Enum mode );
+
+//! Acquires an OpenCL context from the process-wide pool, lazily creating it on first use. Returns nullptr if no matching device is available
+ClContext*	acquireClContext( uint32_t vendor = CMFT_CL_VENDOR_ANY_GPU, uint32_t deviceType = CMFT_CL_DEVICE_TYPE_GPU );
+//! Returns a context obtained with acquireClContext to the pool
+void		releaseClContext( ClContext *context );
+//! Destroys the idle pooled OpenCL contexts, the ones in use are destroyed when released, and unloads OpenCL after the last one. Later acquisitions return nullptr. Automatically called on app cleanup
+void		destroyClContextPool();
+
+//! Compute device used by the radiance filter
+struct ComputeBackend {
+	enum Enum {
+		Auto,		//! OpenCL gpu, then OpenCL cpu device, then cpu threads
+		Cpu,		//! cpu threads only, OpenCL is never loaded
+		OpenClGpu,	//! OpenCL gpu device, falls back to cpu threads
+		OpenClCpu,	//! OpenCL cpu device, falls back to cpu threads
+		NativeCpu,	//! block's own tiled simd filter on cpu threads, OpenCL is never loaded
+		Count
+	};
+};
+
+//! Lobe the radiance filter convolves the source with
+struct RadianceFilterMode {
+	enum Enum {
+		CosinePower,	//! cmft's phong / blinn lobes, see lightingModel, glossScale and glossBias
+		Ggx				//! importance sampled ggx lobe, roughness going linearly from 0 on the first mip to 1 on the last. Always runs on cpu threads
+	};
+};
+
 struct RadianceFilterOptions {
-	RadianceFilterOptions() : mLightingModel( LightingModel::BlinnBrdf ), mEdgeFixup( EdgeFixup::None ), mMipCount( 7 ), mGlossScale( 10 ), mGlossBias( 3 ), mNumCpuProcessingThreads( 0 ), mExcludeBase( false ), mGammaInput( 1.0f ), mGammaOutput( 1.0f ) {}
+	RadianceFilterOptions() : mLightingModel( LightingModel::BlinnBrdf ), mEdgeFixup( EdgeFixup::None ), mMipCount( 7 ), mGlossScale( 10 ), mGlossBias( 3 ), mNumCpuProcessingThreads( 0 ), mExcludeBase( false ), mGammaInput( 1.0f ), mGammaOutput( 1.0f ), mBackend( ComputeBackend::Auto ), mClContext( nullptr ), mFilterMode( RadianceFilterMode::CosinePower ), mGgxSampleCount( 256 ) {}
 
 	//! Sets the gamma correction applied to the input and output of the radiance filter
 	RadianceFilterOptions& gammaCorrection( float gammaInput, float gammaOutput );
@@ -27,7 +104,7 @@ struct RadianceFilterOptions {
 	RadianceFilterOptions& lightingModel( LightingModel::Enum model );
 	//! Sets the filter has to apply a warp edge fixup. 
 	RadianceFilterOptions& edgeFixup( EdgeFixup::Enum fixup );
-	//! Sets the desired number of mipmap
+	//! Sets the desired number of mipmap, clamped to the number of mips the face size allows
 	RadianceFilterOptions& mipCount( uint8_t mips ); 
 	//! Sets the gloss scale used by the radiance filter
 	RadianceFilterOptions& glossScale( uint8_t scale ); 
@@ -37,12 +114,24 @@ struct RadianceFilterOptions {
 	RadianceFilterOptions& numCpuProcessingThreads( uint8_t numThreads ); 
 	//! Sets whether the first level of the output should be filtered or left untouched
 	RadianceFilterOptions& excludeBase( bool exclude );
+	//! Sets the compute backend used by the radiance filter. Defaults to ComputeBackend::Auto, which falls back to cmft's cpu filter. The source pyramid and tiled simd filter of ComputeBackend::NativeCpu, and their speedup, have to be asked for explicitly. Its results are cached under their own keys
+	RadianceFilterOptions& backend( ComputeBackend::Enum backend );
+	//! Sets a user owned OpenCL context used instead of the shared context pool. The context has to outlive the filtering
+	RadianceFilterOptions& clContext( ClContext *context );
+	//! Sets the lobe used by the radiance filter. Defaults to RadianceFilterMode::CosinePower
+	RadianceFilterOptions& filterMode( RadianceFilterMode::Enum mode );
+	//! Sets the number of samples per output texel of the RadianceFilterMode::Ggx filter
+	RadianceFilterOptions& ggxSampleCount( uint32_t count );
 
 	bool				mExcludeBase;
 	LightingModel::Enum mLightingModel;
 	EdgeFixup::Enum		mEdgeFixup;
 	float				mGammaInput, mGammaOutput;
 	uint8_t				mMipCount, mGlossScale, mGlossBias, mNumCpuProcessingThreads; 
+	ComputeBackend::Enum mBackend;
+	ClContext*			mClContext;
+	RadianceFilterMode::Enum mFilterMode;
+	uint32_t			mGgxSampleCount;
 };
 
 //! Creates a Prefiltered Mipmapped Radiance Environment Map from a cmft::Image \a input to a cmft::Image \a output
@@ -53,7 +142,13 @@ ci::gl::TextureCubeMapRef	createPmrem( cmft::Image &input, uint32_t dstFaceSize,
 ci::gl::TextureCubeMapRef	createPmrem( const ci::Surface &source, uint32_t dstFaceSize, const RadianceFilterOptions &options = RadianceFilterOptions() );
 //! Creates a Prefiltered Mipmapped Radiance Environment Map from a cubemap image at \a filePath
 ci::gl::TextureCubeMapRef	createPmrem( const ci::fs::path &filePath, uint32_t dstFaceSize, const RadianceFilterOptions &options = RadianceFilterOptions(), bool cacheEnabled = true );
+//! Creates a Prefiltered Mipmapped Radiance Environment Map from a cubemap image at \a filePath to a cmft::Image \a output
+bool						createPmrem( const ci::fs::path &filePath, cmft::Image &output, uint32_t dstFaceSize, const RadianceFilterOptions &options = RadianceFilterOptions(), bool cacheEnabled = true );
 
+//! Creates the split sum environment brdf lookup table matching the radiance maps filtered with \a options. NoV goes along x and roughness, ie. mip / ( mipCount - 1 ), along y. The red and green channels store the scale and bias applied to F0
+ci::gl::Texture2dRef		createBrdfLut( uint32_t size = 128, const RadianceFilterOptions &options = RadianceFilterOptions(), bool cacheEnabled = true );
+//! Creates the split sum environment brdf lookup table to \a output, one RG16F texel per element. Cached as a dds file in the cache directory, or the temporary directory when not set
+bool						createBrdfLut( std::vector<uint32_t> &output, uint32_t size = 128, const RadianceFilterOptions &options = RadianceFilterOptions(), bool cacheEnabled = true );
 
 struct IrradianceFilterOptions {
 	IrradianceFilterOptions() : mGammaInput( 1.0f ), mGammaOutput( 1.0f ) {}
@@ -72,8 +167,241 @@ ci::gl::TextureCubeMapRef	createIem( cmft::Image &input, uint32_t dstFaceSize, c
 ci::gl::TextureCubeMapRef	createIem( const ci::Surface &source, uint32_t dstFaceSize, const IrradianceFilterOptions &options = IrradianceFilterOptions() );
 //! Creates a Prefiltered Mipmapped Radiance Environment Map from a cubemap image at \a filePath
 ci::gl::TextureCubeMapRef	createIem( const ci::fs::path &filePath, uint32_t dstFaceSize, const IrradianceFilterOptions &options = IrradianceFilterOptions(), bool cacheEnabled = true );
+//! Creates an Irradiance Environment Map from a cubemap image at \a filePath to a cmft::Image \a output
+bool						createIem( const ci::fs::path &filePath, cmft::Image &output, uint32_t dstFaceSize, const IrradianceFilterOptions &options = IrradianceFilterOptions(), bool cacheEnabled = true );
+
+//! L2 spherical harmonics irradiance coefficients, convolved with the cosine lobe. See assets/CinderCmftSh.glsl for the matching evaluation
+typedef std::array<ci::vec3, SH_COEFF_NUM> ShCoeffs;
+
+//! Computes the irradiance spherical harmonics coefficients \a coeffs of a cmft::Image \a input. The output gamma has to be applied after evaluation
+bool	createIemSh( cmft::Image &input, ShCoeffs &coeffs, const IrradianceFilterOptions &options = IrradianceFilterOptions() );
+//! Computes the irradiance spherical harmonics coefficients \a coeffs of a ci::Surface \a source. The output gamma has to be applied after evaluation
+bool	createIemSh( const ci::Surface &source, ShCoeffs &coeffs, const IrradianceFilterOptions &options = IrradianceFilterOptions() );
+//! Computes the irradiance spherical harmonics coefficients \a coeffs of the image at \a filePath. The output gamma has to be applied after evaluation
+bool	createIemSh( const ci::fs::path &filePath, ShCoeffs &coeffs, const IrradianceFilterOptions &options = IrradianceFilterOptions() );
+
+namespace detail { struct CubemapTable; struct SourceBlocks; struct GgxLobes; }
+
+typedef std::shared_ptr<class FilterPlan> FilterPlanRef;
+
+//! Radiance or irradiance filter prepared for a fixed face size and options. Everything that doesn't depend on the input is computed once and reused by each execute call. Not thread safe, use one plan per thread
+class FilterPlan {
+public:
+	//! Creates a plan filtering Prefiltered Mipmapped Radiance Environment Maps of size \a dstFaceSize. The OpenCL context, if any, is held until the plan is destroyed
+	static FilterPlanRef create( uint32_t dstFaceSize, const RadianceFilterOptions &options = RadianceFilterOptions() );
+	//! Creates a plan filtering Irradiance Environment Maps of size \a dstFaceSize
+	static FilterPlanRef create( uint32_t dstFaceSize, const IrradianceFilterOptions &options );
+	~FilterPlan();
+
+	//! Filters a cmft::Image \a input to a cmft::Image \a output. \a input is converted, resized and gamma corrected in place
+	bool						execute( cmft::Image &input, cmft::Image &output );
+	//! Filters a cmft::Image \a input to a new cubemap
+	ci::gl::TextureCubeMapRef	execute( cmft::Image &input );
+
+	//! Returns whether the plan filters radiance or irradiance maps
+	bool		isRadiance() const { return mRadiance; }
+	//! Returns the output face size
+	uint32_t	getFaceSize() const { return mFaceSize; }
+	//! Returns the number of output mips, after clamping to the face size
+	uint8_t		getMipCount() const { return mMipCount; }
+	//! Returns the specular power of each output mip, adjusted for the lighting model. Empty for RadianceFilterMode::Ggx
+	const std::vector<float>&	getSpecularPowers() const { return mSpecularPowers; }
+	//! Returns the angle in radians past which each output mip lobe is negligible. Empty for RadianceFilterMode::Ggx
+	const std::vector<float>&	getFilterAngles() const { return mFilterAngles; }
+	//! Returns the source level each output mip of the native filter is convolved against, always 0 with the other backends
+	const std::vector<uint8_t>&	getSourceLevels() const { return mSourceLevels; }
+	//! Returns the OpenCL context used by the plan or nullptr when filtering on cpu threads
+	ClContext*	getClContext() const { return mClContext; }
+	//! Returns the backend the radiance filter runs on after falling back, Auto for a user provided OpenCL context
+	ComputeBackend::Enum	getBackend() const { return mBackend; }
+
+	const RadianceFilterOptions&	getRadianceOptions() const { return mRadianceOptions; }
+	const IrradianceFilterOptions&	getIrradianceOptions() const { return mIrradianceOptions; }
+
+protected:
+	FilterPlan( uint32_t dstFaceSize, bool radiance );
+
+	bool executeRadiance( cmft::Image &input, cmft::Image &output );
+	bool executeIrradiance( cmft::Image &input, cmft::Image &output );
+
+	bool						mRadiance;
+	uint32_t					mFaceSize;
+	uint8_t						mMipCount;
+	RadianceFilterOptions		mRadianceOptions;
+	IrradianceFilterOptions		mIrradianceOptions;
+	std::vector<float>			mSpecularPowers, mFilterAngles;
+	ClContext*					mClContext;
+	bool						mPooledClContext;
+	ComputeBackend::Enum		mBackend;
+	std::shared_ptr<const detail::CubemapTable> mTable;
+	std::vector<uint8_t>		mSourceLevels;
+	std::vector<std::shared_ptr<const detail::SourceBlocks>> mSourceBlocks;
+	std::shared_ptr<const detail::GgxLobes> mGgxLobes;
+};
+
+struct EnvironmentOptions {
+	EnvironmentOptions() : mSkybox( true ), mCacheEnabled( true ), mCacheSkybox( false ), mPmremSize( 256 ), mIemSize( 64 ) {}
+
+	//! Sets whether the unfiltered skybox cubemap should be created
+	EnvironmentOptions& skybox( bool enabled );
+	//! Sets the face size and options of the radiance map. A face size of 0 disables the radiance map
+	EnvironmentOptions& pmrem( uint32_t faceSize, const RadianceFilterOptions &options = RadianceFilterOptions() );
+	//! Sets the face size and options of the irradiance map. A face size of 0 disables the irradiance map
+	EnvironmentOptions& iem( uint32_t faceSize, const IrradianceFilterOptions &options = IrradianceFilterOptions() );
+	//! Sets whether the radiance and irradiance maps are cached
+	EnvironmentOptions& cache( bool enabled );
+	//! Sets whether the converted skybox cubemap is cached as well. Disabled by default as the skybox is stored at the source resolution
+	EnvironmentOptions& cacheSkybox( bool enabled );
+
+	bool					mSkybox, mCacheEnabled, mCacheSkybox;
+	uint32_t				mPmremSize, mIemSize;
+	RadianceFilterOptions	mPmremOptions;
+	IrradianceFilterOptions	mIemOptions;
+};
+
+//! Skybox, radiance and irradiance cubemaps of an environment
+struct EnvironmentSet {
+	ci::gl::TextureCubeMapRef mEm, mPmrem, mIem;
+};
+
+//! Creates the skybox, radiance and irradiance maps of the image at \a filePath, decoding and converting the source only once
+EnvironmentSet	createEnvironmentSet( const ci::fs::path &filePath, const EnvironmentOptions &options = EnvironmentOptions() );
+//! Creates the skybox \a em, radiance \a pmrem and irradiance \a iem cmft::Images of the image at \a filePath, decoding and converting the source only once
+bool			createEnvironmentSet( const ci::fs::path &filePath, cmft::Image &em, cmft::Image &pmrem, cmft::Image &iem, const EnvironmentOptions &options = EnvironmentOptions() );
+//! Returns whether every map enabled in \a options is already cached for the current version of the image at \a filePath
+bool			isEnvironmentSetCached( const ci::fs::path &filePath, const EnvironmentOptions &options = EnvironmentOptions() );
+//! Returns the cache files createEnvironmentSet reads and writes for the current version of the image at \a filePath and \a options
+std::vector<ci::fs::path>	getEnvironmentSetCachePaths( const ci::fs::path &filePath, const EnvironmentOptions &options = EnvironmentOptions() );
+//! Removes the cached skybox, radiance and irradiance maps of the image at \a filePath but the files in \a keep, ie. the ones left by previous versions of the source, sizes or options. Sources with the same stem share their cache file names, \a keep has to list the files of all of them. Returns the number of files removed
+size_t			pruneCache( const ci::fs::path &filePath, const std::vector<ci::fs::path> &keep );
+
+typedef std::shared_ptr<class AsyncTextureCubeMap> AsyncTextureCubeMapRef;
+
+//! Handle to a cubemap being loaded and filtered on a worker thread. The opengl texture is only created when requested on the main thread. Bakes still queued on app cleanup are dropped and report a failure
+class AsyncTextureCubeMap {
+public:
+	//! Returns whether the worker thread is done
+	bool isReady() const;
+	//! Blocks until the worker thread is done
+	void wait() const;
+	//! Returns whether the worker thread is done and managed to produce the cubemap
+	bool succeeded() const;
+	//! Returns the cubemap or a null reference if the worker thread isn't done yet. Has to be called from the thread owning the opengl context
+	ci::gl::TextureCubeMapRef getTexture();
+
+	//! \a function and \a source label the upload in the bake and texture statistics
+	AsyncTextureCubeMap( const std::shared_future<bool> &future, const std::shared_ptr<cmft::Image> &image, const char *function = "createTextureCubemapAsync", const ci::fs::path &source = ci::fs::path() );
+protected:
+	std::shared_future<bool>	mFuture;
+	std::shared_ptr<cmft::Image> mImage;
+	ci::gl::TextureCubeMapRef	mTexture;
+	const char*					mFunction;
+	ci::fs::path				mSource;
+};
+
+//! Asynchronously converts a cmft::Image \a image to a cubemap. \a image is copied and can be released right away
+AsyncTextureCubeMapRef	createTextureCubemapAsync( const cmft::Image &image );
+//! Asynchronously loads and converts the image at \a filePath to a cubemap
+AsyncTextureCubeMapRef	createTextureCubemapAsync( const ci::fs::path &filePath );
+//! Asynchronously creates a Prefiltered Mipmapped Radiance Environment Map from a cmft::Image \a input. \a input is copied and can be released right away
+AsyncTextureCubeMapRef	createPmremAsync( const cmft::Image &input, uint32_t dstFaceSize, const RadianceFilterOptions &options = RadianceFilterOptions() );
+//! Asynchronously creates a Prefiltered Mipmapped Radiance Environment Map from a cubemap image at \a filePath
+AsyncTextureCubeMapRef	createPmremAsync( const ci::fs::path &filePath, uint32_t dstFaceSize, const RadianceFilterOptions &options = RadianceFilterOptions(), bool cacheEnabled = true );
+//! Handles to an environment set being created on a worker thread
+struct AsyncEnvironmentSet {
+	AsyncTextureCubeMapRef mEm, mPmrem, mIem;
+};
+
+//! Asynchronously creates the skybox, radiance and irradiance maps of the image at \a filePath
+AsyncEnvironmentSet		createEnvironmentSetAsync( const ci::fs::path &filePath, const EnvironmentOptions &options = EnvironmentOptions() );
+//! Asynchronously creates an Irradiance Environment Map from a cmft::Image \a input. \a input is copied and can be released right away
+AsyncTextureCubeMapRef	createIemAsync( const cmft::Image &input, uint32_t dstFaceSize, const IrradianceFilterOptions &options = IrradianceFilterOptions() );
+//! Asynchronously creates an Irradiance Environment Map from a cubemap image at \a filePath
+AsyncTextureCubeMapRef	createIemAsync( const ci::fs::path &filePath, uint32_t dstFaceSize, const IrradianceFilterOptions &options = IrradianceFilterOptions(), bool cacheEnabled = true );
+
+//! Stages timed in BakeStats
+struct BakeStage {
+	enum Enum {
+		Load,		//! source image decoding
+		Convert,	//! layout and texture format conversions
+		Resize,		//! resize of the input to the output face size
+		Gamma,		//! gamma correction of the input and output
+		Filter,		//! filter setup and radiance or irradiance filtering
+		BrdfLut,	//! brdf lookup table integration
+		Sh,			//! spherical harmonics projection and evaluation
+		CacheLoad,	//! cached results read from disk
+		CacheSave,	//! results written to the cache
+		Upload,		//! opengl texture creation
+		Count
+	};
+};
+
+//! Returns the name of \a stage
+const char* getBakeStageName( BakeStage::Enum stage );
+
+//! Timings and statistics of a create* call. Nested calls are accounted to the outermost one
+struct BakeStats {
+	BakeStats();
+
+	//! Returns the sum of the stage times, in seconds
+	double getStagesTime() const;
+
+	std::string				mFunction;						//! name of the outermost create function
+	ci::fs::path			mSource;						//! source file, empty for in memory inputs
+	double					mTotalTime;						//! wall time of the whole call, in seconds
+	double					mStageTimes[BakeStage::Count];	//! wall time of each stage, in seconds
+	uint64_t				mBytesAllocated;				//! image memory allocated by the call, in bytes
+	uint32_t				mCacheHits, mCacheMisses;
+	bool					mFiltered;						//! whether a filter ran, the backend and thread count are only set if so
+	ComputeBackend::Enum	mBackend;						//! backend the filter ran on, Auto for a user provided OpenCL context
+	uint32_t				mNumThreads;					//! number of cpu threads the filter ran on
+};
+
+//! Sets a function called with the statistics of every create* call, on the thread the call ran on. Async variants report from their worker thread
+void		setBakeStatsCallback( const std::function<void( const BakeStats& )> &callback );
+//! Returns the statistics of the last create* call completed on the calling thread
+BakeStats	getLastBakeStats();
+//! Returns the statistics of the last 32 create* calls completed on any thread, most recent first
+std::vector<BakeStats>	getRecentBakeStats();
+
+//! Process-wide counters of the block activity, updated by every create* call
+struct Metrics {
+	Metrics();
+
+	uint64_t	mCacheHits, mCacheMisses;				//! lookups of the cached radiance, irradiance, skybox and brdf files
+	uint64_t	mBytesRead, mBytesWritten;				//! source and cache files
+	uint64_t	mBakes;									//! outermost create* calls
+	uint64_t	mFilterCounts[ComputeBackend::Count];	//! filter runs per backend
+	double		mFilterTimes[ComputeBackend::Count];	//! filter wall time per backend, in seconds
+	uint64_t	mLiveImages, mLiveImageBytes;			//! image buffers held by the create* calls running, outputs stop counting once returned
+	uint64_t	mPeakImageBytes;						//! peak of mLiveImageBytes since the last reset
+	uint64_t	mClContextCreations;					//! OpenCL contexts created by the pool
+};
+
+//! Returns a snapshot of the process-wide counters. Never blocks the create* calls updating them
+Metrics		getMetrics();
+//! Resets the process-wide counters, except the live images. The peak restarts from the current live bytes
+void		resetMetrics();
+
+//! Memory and upload cost of a cubemap created by the block
+struct TextureStats {
+	TextureStats();
+
+	std::string				mFunction;			//! name of the create function that uploaded the cubemap
+	ci::fs::path			mSource;			//! source file, empty for in memory inputs
+	uint32_t				mFaceSize;
+	uint8_t					mNumMips;
+	GLint					mInternalFormat;
+	uint64_t				mCpuBytes;			//! image memory staged for the upload, in bytes. Released once the cubemap is created
+	uint64_t				mGpuBytes;			//! estimated video memory, in bytes. Three channel formats are counted as padded to four
+	double					mUploadTime;		//! cpu time of the upload, in seconds
+	double					mGpuUploadTime;		//! gpu time of the upload measured with a timer query, in seconds. Negative while pending or when timer queries aren't available
+};
+
+//! Returns the statistics of the cubemaps created by the block and still alive, oldest first. Has to be called from the thread owning the opengl context
+std::vector<TextureStats>	getTextureStats();
 
-//! Connects cmft messages to cinder console
+//! Connects cmft messages to cinder console through the asynchronous logger, see setLogSink() and setLogLevel()
 void connectConsole( bool warning, bool info );
 
 }
\ No newline at end of file
@@ -0,0 +1,152 @@
+#pragma once
+
+// performance panel for applications using the ImGui block, the Cmft block itself doesn't depend on it
+
+#include "CinderImGui.h"
+#include "CinderCmft.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace cmft {
+
+namespace detail {
+	inline const char* getPanelBackendName( ComputeBackend::Enum backend )
+	{
+		switch( backend ) {
+			case ComputeBackend::Auto:		return "opencl (user context)";
+			case ComputeBackend::Cpu:		return "cpu";
+			case ComputeBackend::OpenClGpu:	return "opencl gpu";
+			case ComputeBackend::OpenClCpu:	return "opencl cpu";
+			case ComputeBackend::NativeCpu:	return "native";
+			default:						break;
+		}
+		return "unknown";
+	}
+
+	inline const char* getPanelFormatName( GLint internalFormat )
+	{
+		switch( internalFormat ) {
+			case GL_RGB8:		return "RGB8";
+			case GL_RGBA8:		return "RGBA8";
+			case GL_BGR:		return "BGR8";
+			case GL_BGRA:		return "BGRA8";
+			case GL_RGB16F:		return "RGB16F";
+			case GL_RGBA16F:	return "RGBA16F";
+			case GL_RGB32F:		return "RGB32F";
+			case GL_RGBA32F:	return "RGBA32F";
+#if ! defined( CINDER_GL_ES )
+			case GL_RGB16:		return "RGB16";
+			case GL_RGBA16:		return "RGBA16";
+#endif
+			default:			break;
+		}
+		return "other";
+	}
+
+	inline float toMegabytes( uint64_t bytes )
+	{
+		return static_cast<float>( bytes ) / ( 1024.0f * 1024.0f );
+	}
+
+	inline void drawBakeStats( const BakeStats &stats )
+	{
+		ui::Text( "total %.1f ms, %.1f MB of images allocated", stats.mTotalTime * 1000.0, toMegabytes( stats.mBytesAllocated ) );
+		ui::Text( "cache %u hits, %u misses", stats.mCacheHits, stats.mCacheMisses );
+		if( stats.mFiltered ) {
+			ui::Text( "filtered with %s on %u threads", getPanelBackendName( stats.mBackend ), stats.mNumThreads );
+		}
+
+		// stage bars are relative to the whole call so that the unaccounted time stands out
+		for( int stage = 0; stage < BakeStage::Count; ++stage ) {
+			if( stats.mStageTimes[stage] <= 0.0 ) {
+				continue;
+			}
+			char overlay[64];
+			snprintf( overlay, sizeof( overlay ), "%s %.2f ms", getBakeStageName( static_cast<BakeStage::Enum>( stage ) ), stats.mStageTimes[stage] * 1000.0 );
+			ui::ProgressBar( stats.mTotalTime > 0.0 ? static_cast<float>( stats.mStageTimes[stage] / stats.mTotalTime ) : 0.0f, ImVec2( -1.0f, 0.0f ), overlay );
+		}
+	}
+}
+
+//! Draws a window with the timings of the last bakes, the cache and image memory counters and the cost of every live cubemap created by the block. Has to be called from the thread owning the opengl context, between the ImGui frame calls
+inline void drawPerformancePanel( const std::string &name = "Cmft Performance" )
+{
+	ui::ScopedWindow scopedWindow( name );
+
+	// bakes, most recent first
+	auto bakes = getRecentBakeStats();
+	ui::SetNextTreeNodeOpen( true, ImGuiSetCond_Once );
+	if( ui::CollapsingHeader( "Bakes" ) ) {
+		if( bakes.empty() ) {
+			ui::TextDisabled( "no bake yet" );
+		}
+		for( size_t i = 0; i < bakes.size(); ++i ) {
+			const auto &bake = bakes[i];
+			const std::string source = bake.mSource.empty() ? "memory" : bake.mSource.filename().string();
+			if( i == 0 ) {
+				ui::SetNextTreeNodeOpen( true, ImGuiSetCond_Once );
+			}
+			if( ui::TreeNode( reinterpret_cast<void*>( i ), "%s %s %.1f ms", bake.mFunction.c_str(), source.c_str(), bake.mTotalTime * 1000.0 ) ) {
+				detail::drawBakeStats( bake );
+				ui::TreePop();
+			}
+		}
+	}
+
+	// process-wide counters
+	auto metrics = getMetrics();
+	ui::SetNextTreeNodeOpen( true, ImGuiSetCond_Once );
+	if( ui::CollapsingHeader( "Cache and memory" ) ) {
+		const uint64_t lookups = metrics.mCacheHits + metrics.mCacheMisses;
+		ui::Text( "cache %llu hits, %llu misses (%.0f%% hits)", static_cast<unsigned long long>( metrics.mCacheHits ), static_cast<unsigned long long>( metrics.mCacheMisses ), lookups ? 100.0 * metrics.mCacheHits / lookups : 0.0 );
+		ui::Text( "disk %.1f MB read, %.1f MB written", detail::toMegabytes( metrics.mBytesRead ), detail::toMegabytes( metrics.mBytesWritten ) );
+		ui::Text( "images %llu live, %.1f MB, %.1f MB peak", static_cast<unsigned long long>( metrics.mLiveImages ), detail::toMegabytes( metrics.mLiveImageBytes ), detail::toMegabytes( metrics.mPeakImageBytes ) );
+		ui::Text( "%llu bakes, %llu OpenCL contexts created", static_cast<unsigned long long>( metrics.mBakes ), static_cast<unsigned long long>( metrics.mClContextCreations ) );
+		if( ui::Button( "Reset" ) ) {
+			resetMetrics();
+		}
+	}
+
+	// live cubemaps
+	auto textures = getTextureStats();
+	ui::SetNextTreeNodeOpen( true, ImGuiSetCond_Once );
+	if( ui::CollapsingHeader( "Cubemaps" ) ) {
+		uint64_t cpuBytes = 0, gpuBytes = 0;
+		ui::Columns( 5, "cmftCubemaps" );
+		for( auto header : { "source", "size", "staged / gpu", "upload cpu", "upload gpu" } ) {
+			ui::TextDisabled( "%s", header );
+			ui::NextColumn();
+		}
+		ui::Separator();
+		for( const auto &texture : textures ) {
+			const std::string source = texture.mSource.empty() ? "memory" : texture.mSource.filename().string();
+			ui::Text( "%s", source.c_str() );
+			if( ui::IsItemHovered() ) {
+				ui::SetTooltip( "%s", texture.mFunction.c_str() );
+			}
+			ui::NextColumn();
+			ui::Text( "%u %s %u mips", texture.mFaceSize, detail::getPanelFormatName( texture.mInternalFormat ), static_cast<uint32_t>( texture.mNumMips ) );
+			ui::NextColumn();
+			ui::Text( "%.2f / %.2f MB", detail::toMegabytes( texture.mCpuBytes ), detail::toMegabytes( texture.mGpuBytes ) );
+			ui::NextColumn();
+			ui::Text( "%.2f ms", texture.mUploadTime * 1000.0 );
+			ui::NextColumn();
+			if( texture.mGpuUploadTime < 0.0 ) {
+				ui::TextDisabled( "n/a" );
+			}
+			else {
+				ui::Text( "%.2f ms", texture.mGpuUploadTime * 1000.0 );
+			}
+			ui::NextColumn();
+			cpuBytes += texture.mCpuBytes;
+			gpuBytes += texture.mGpuBytes;
+		}
+		ui::Columns( 1 );
+		ui::Separator();
+		ui::Text( "%u cubemaps, %.2f MB staged, %.2f MB gpu", static_cast<uint32_t>( textures.size() ), detail::toMegabytes( cpuBytes ), detail::toMegabytes( gpuBytes ) );
+	}
+}
+
+} // namespace cmft
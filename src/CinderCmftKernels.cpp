@@ -0,0 +1,1186 @@
+#include "CinderCmftKernels.h"
+#include "CinderCmftTrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// avx2 is only used when the whole block is compiled for it ( -mavx2 / /arch:AVX2 ), sse2 is always available on x64
+#if defined( __AVX2__ )
+	#include <immintrin.h>
+	#define CMFT_SIMD_AVX2
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+	#include <emmintrin.h>
+	#define CMFT_SIMD_SSE2
+#endif
+
+namespace cmft { namespace detail {
+
+namespace {
+	double areaElement( double x, double y )
+	{
+		return std::atan2( x * y, std::sqrt( x * x + y * y + 1.0 ) );
+	}
+}
+
+namespace {
+	// tables stay alive while a plan or a filter uses them, the last few sizes are kept for the next bakes
+	const size_t sMaxRecentCubemapTables = 4;
+
+	void touchCubemapTable( std::deque<std::shared_ptr<const CubemapTable>> &recent, const std::shared_ptr<const CubemapTable> &table )
+	{
+		auto it = std::find( recent.begin(), recent.end(), table );
+		if( it != recent.end() ) {
+			recent.erase( it );
+		}
+		recent.push_front( table );
+		if( recent.size() > sMaxRecentCubemapTables ) {
+			recent.pop_back();
+		}
+	}
+}
+
+std::shared_ptr<const CubemapTable> getCubemapTable( uint32_t faceSize )
+{
+	static std::mutex sMutex;
+	static std::map<uint32_t, std::weak_ptr<const CubemapTable>> sTables;
+	static std::deque<std::shared_ptr<const CubemapTable>> sRecentTables;
+
+	std::lock_guard<std::mutex> lock( sMutex );
+	auto cached = sTables.find( faceSize );
+	if( cached != sTables.end() ) {
+		if( auto table = cached->second.lock() ) {
+			touchCubemapTable( sRecentTables, table );
+			return table;
+		}
+	}
+
+	auto table = std::make_shared<CubemapTable>();
+	const size_t numTexels = static_cast<size_t>( faceSize ) * faceSize;
+	table->mFaceSize = faceSize;
+	table->mU.resize( numTexels );
+	table->mV.resize( numTexels );
+	table->mW.resize( numTexels );
+	table->mSolidAngle.resize( numTexels );
+
+	const double invFaceSize = 1.0 / faceSize;
+	for( uint32_t y = 0; y < faceSize; ++y ) {
+		for( uint32_t x = 0; x < faceSize; ++x ) {
+			const double u = 2.0 * ( x + 0.5 ) * invFaceSize - 1.0;
+			const double v = 2.0 * ( y + 0.5 ) * invFaceSize - 1.0;
+			const double invLength = 1.0 / std::sqrt( u * u + v * v + 1.0 );
+
+			// solid angle from the texel corners
+			const double x0 = 2.0 * x * invFaceSize - 1.0;
+			const double y0 = 2.0 * y * invFaceSize - 1.0;
+			const double x1 = 2.0 * ( x + 1 ) * invFaceSize - 1.0;
+			const double y1 = 2.0 * ( y + 1 ) * invFaceSize - 1.0;
+			const double solidAngle = areaElement( x0, y0 ) - areaElement( x0, y1 ) - areaElement( x1, y0 ) + areaElement( x1, y1 );
+
+			const size_t i = y * faceSize + x;
+			table->mU[i] = static_cast<float>( u * invLength );
+			table->mV[i] = static_cast<float>( v * invLength );
+			table->mW[i] = static_cast<float>( invLength );
+			table->mSolidAngle[i] = static_cast<float>( solidAngle );
+		}
+	}
+
+	for( auto it = sTables.begin(); it != sTables.end(); ) {
+		it = it->second.expired() ? sTables.erase( it ) : std::next( it );
+	}
+	sTables[faceSize] = table;
+	touchCubemapTable( sRecentTables, table );
+	return table;
+}
+
+const FaceBasis& getFaceBasis( uint8_t face )
+{
+	static const FaceBasis sFaceBases[CUBE_FACE_NUM] = {
+		{ { 2, 1, 0 }, {  1.0f, -1.0f, -1.0f } }, // +x = (  w, -v, -u )
+		{ { 2, 1, 0 }, { -1.0f, -1.0f,  1.0f } }, // -x = ( -w, -v,  u )
+		{ { 0, 2, 1 }, {  1.0f,  1.0f,  1.0f } }, // +y = (  u,  w,  v )
+		{ { 0, 2, 1 }, {  1.0f, -1.0f, -1.0f } }, // -y = (  u, -w, -v )
+		{ { 0, 1, 2 }, {  1.0f, -1.0f,  1.0f } }, // +z = (  u, -v,  w )
+		{ { 0, 1, 2 }, { -1.0f, -1.0f, -1.0f } }  // -z = ( -u, -v, -w )
+	};
+	return sFaceBases[face];
+}
+
+float getSpecularPower( uint8_t mip, uint8_t mipCount, uint8_t glossScale, uint8_t glossBias, LightingModel::Enum lightingModel )
+{
+	const float glossiness = mipCount > 1 ? std::max( 0.0f, 1.0f - (float) mip / (float) ( mipCount - 1 ) ) : 1.0f;
+	const float specularPower = std::exp2( glossScale * glossiness + glossBias );
+	switch( lightingModel ) {
+	case LightingModel::PhongBrdf:	return specularPower + 1.0f;
+	case LightingModel::Blinn:		return specularPower / 4.0f;
+	case LightingModel::BlinnBrdf:	return specularPower / 4.0f + 1.0f;
+	case LightingModel::Phong:
+	default:						return specularPower;
+	}
+}
+
+float getFilterAngle( float specularPower )
+{
+	// cos( angle ) ^ power drops under the threshold past the filter angle
+	const float threshold = 0.000001f;
+	return std::acos( std::pow( threshold, 1.0f / specularPower ) );
+}
+
+namespace {
+	// persistent helper threads shared by every parallelFor, the calling thread always takes part so that concurrent
+	// and nested loops complete even when every helper is busy
+	class ParallelForPool {
+	public:
+		struct Job {
+			Job( size_t count, const std::function<void( size_t, size_t )> &func, size_t maxHelpers )
+				: mFunc( func ), mCount( count ), mNext( 0 ), mNextSlot( 1 ), mMaxHelpers( maxHelpers ), mNumHelpers( 0 ), mNumRunning( 0 ) {}
+
+			const std::function<void( size_t, size_t )>	&mFunc;
+			const size_t								mCount;
+			std::atomic<size_t>							mNext, mNextSlot;
+			// guarded by the pool mutex
+			size_t										mMaxHelpers, mNumHelpers, mNumRunning;
+		};
+
+		ParallelForPool( size_t numThreads ) : mStopped( false )
+		{
+			for( size_t i = 0; i < numThreads; ++i ) {
+				mThreads.emplace_back( [this]() {
+					std::unique_lock<std::mutex> lock( mMutex );
+					while( true ) {
+						Job *job = nullptr;
+						mCondition.wait( lock, [this, &job]() { return mStopped || ( job = findJob() ) != nullptr; } );
+						if( mStopped ) {
+							return;
+						}
+						++job->mNumHelpers;
+						++job->mNumRunning;
+						lock.unlock();
+						setTraceThreadName( "cmft filter" );
+						runJob( *job, job->mNextSlot++ );
+						lock.lock();
+						if( --job->mNumRunning == 0 ) {
+							mJobDone.notify_all();
+						}
+					}
+				} );
+			}
+		}
+		~ParallelForPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				mStopped = true;
+			}
+			mCondition.notify_all();
+			for( auto &thread : mThreads ) {
+				thread.join();
+			}
+		}
+
+		size_t getNumThreads() const { return mThreads.size(); }
+
+		void run( Job &job )
+		{
+			if( job.mMaxHelpers ) {
+				{
+					std::lock_guard<std::mutex> lock( mMutex );
+					mJobs.push_back( &job );
+				}
+				job.mMaxHelpers > 1 ? mCondition.notify_all() : mCondition.notify_one();
+			}
+
+			runJob( job, 0 );
+
+			// every index is taken, wait for the helpers still working on theirs
+			if( job.mMaxHelpers ) {
+				std::unique_lock<std::mutex> lock( mMutex );
+				mJobs.erase( std::find( mJobs.begin(), mJobs.end(), &job ) );
+				mJobDone.wait( lock, [&job]() { return job.mNumRunning == 0; } );
+			}
+		}
+
+	protected:
+		// expects the mutex to be locked
+		Job* findJob() const
+		{
+			for( Job *job : mJobs ) {
+				if( job->mNumHelpers < job->mMaxHelpers && job->mNext.load() < job->mCount ) {
+					return job;
+				}
+			}
+			return nullptr;
+		}
+
+		static void runJob( Job &job, size_t slot )
+		{
+			CMFT_TRACE_SCOPE( "parallelFor" );
+			for( size_t i = job.mNext++; i < job.mCount; i = job.mNext++ ) {
+				job.mFunc( i, slot );
+			}
+		}
+
+		bool						mStopped;
+		std::mutex					mMutex;
+		std::condition_variable		mCondition, mJobDone;
+		std::vector<Job*>			mJobs;
+		std::vector<std::thread>	mThreads;
+	};
+
+	ParallelForPool& getParallelForPool()
+	{
+		static ParallelForPool pool( std::max( 1u, std::thread::hardware_concurrency() ) - 1 );
+		return pool;
+	}
+}
+
+size_t getParallelForSlotCount( size_t count, size_t numThreads )
+{
+	if( ! numThreads ) {
+		numThreads = std::max( 1u, std::thread::hardware_concurrency() );
+	}
+	return std::max<size_t>( 1, std::min( std::min( numThreads, count ), getParallelForPool().getNumThreads() + 1 ) );
+}
+
+void parallelForSlots( size_t count, const std::function<void( size_t, size_t )> &func, size_t numThreads )
+{
+	ParallelForPool::Job job( count, func, getParallelForSlotCount( count, numThreads ) - 1 );
+	getParallelForPool().run( job );
+}
+
+void parallelFor( size_t count, const std::function<void( size_t )> &func, size_t numThreads )
+{
+	parallelForSlots( count, [&func]( size_t index, size_t ) { func( index ); }, numThreads );
+}
+
+namespace {
+	// minimal wrappers so that the kernels are written once for every instruction set
+	struct ScalarPack {
+		static const size_t Width = 1;
+		typedef float Type;
+
+		static Type zero() { return 0.0f; }
+		static Type set1( float value ) { return value; }
+		static Type load( const float *ptr ) { return *ptr; }
+		static Type add( Type a, Type b ) { return a + b; }
+		static Type sub( Type a, Type b ) { return a - b; }
+		static Type mul( Type a, Type b ) { return a * b; }
+		static Type madd( Type a, Type b, Type c ) { return a * b + c; }
+		static Type maskGreater( Type a, Type b, Type value ) { return a > b ? value : 0.0f; }
+		static Type pow( Type base, Type exponent ) { return std::pow( std::max( base, 0.0f ), exponent ); }
+		static void loadRgb( const float *rgba, Type &r, Type &g, Type &b )
+		{
+			r = rgba[0];
+			g = rgba[1];
+			b = rgba[2];
+		}
+		static double sum( Type a ) { return a; }
+	};
+
+#if defined( CMFT_SIMD_SSE2 )
+	struct SimdPack {
+		static const size_t Width = 4;
+		typedef __m128 Type;
+
+		static Type zero() { return _mm_setzero_ps(); }
+		static Type set1( float value ) { return _mm_set1_ps( value ); }
+		static Type load( const float *ptr ) { return _mm_loadu_ps( ptr ); }
+		static Type add( Type a, Type b ) { return _mm_add_ps( a, b ); }
+		static Type sub( Type a, Type b ) { return _mm_sub_ps( a, b ); }
+		static Type mul( Type a, Type b ) { return _mm_mul_ps( a, b ); }
+		static Type madd( Type a, Type b, Type c ) { return _mm_add_ps( _mm_mul_ps( a, b ), c ); }
+		static Type maskGreater( Type a, Type b, Type value ) { return _mm_and_ps( _mm_cmpgt_ps( a, b ), value ); }
+		// base ^ exponent as exp2( exponent * log2( base ) ). the exponents reach thousands, so log2 has to be accurate to the last bits
+		static Type log2( Type x )
+		{
+			// x = mantissa * 2 ^ exponent, with mantissa in [ sqrt( 0.5 ), sqrt( 2 ) )
+			const __m128i bits = _mm_castps_si128( x );
+			__m128 exponent = _mm_cvtepi32_ps( _mm_sub_epi32( _mm_srli_epi32( _mm_and_si128( bits, _mm_set1_epi32( 0x7F800000 ) ), 23 ), _mm_set1_epi32( 127 ) ) );
+			__m128 mantissa = _mm_or_ps( _mm_castsi128_ps( _mm_and_si128( bits, _mm_set1_epi32( 0x007FFFFF ) ) ), _mm_set1_ps( 1.0f ) );
+			const __m128 large = _mm_cmpgt_ps( mantissa, _mm_set1_ps( 1.41421356f ) );
+			mantissa = _mm_or_ps( _mm_and_ps( large, _mm_mul_ps( mantissa, _mm_set1_ps( 0.5f ) ) ), _mm_andnot_ps( large, mantissa ) );
+			exponent = _mm_add_ps( exponent, _mm_and_ps( large, _mm_set1_ps( 1.0f ) ) );
+
+			// ln( mantissa ) = 2 atanh( s ), with s = ( mantissa - 1 ) / ( mantissa + 1 ) small enough for 5 terms of the series
+			const __m128 s = _mm_div_ps( _mm_sub_ps( mantissa, _mm_set1_ps( 1.0f ) ), _mm_add_ps( mantissa, _mm_set1_ps( 1.0f ) ) );
+			const __m128 s2 = _mm_mul_ps( s, s );
+			__m128 p = _mm_set1_ps( 1.0f / 9.0f );
+			p = madd( p, s2, _mm_set1_ps( 1.0f / 7.0f ) );
+			p = madd( p, s2, _mm_set1_ps( 1.0f / 5.0f ) );
+			p = madd( p, s2, _mm_set1_ps( 1.0f / 3.0f ) );
+			p = madd( p, s2, _mm_set1_ps( 1.0f ) );
+			return madd( _mm_mul_ps( s, p ), _mm_set1_ps( 2.0f * 1.44269504f ), exponent );
+		}
+		// polynomial fit from http://jrfonseca.blogspot.com/2008/09/fast-sse2-pow-tables-or-polynomials.html
+		static Type exp2( Type x )
+		{
+			x = _mm_max_ps( _mm_min_ps( x, _mm_set1_ps( 129.0f ) ), _mm_set1_ps( -126.99999f ) );
+			const __m128i integer = _mm_cvtps_epi32( _mm_sub_ps( x, _mm_set1_ps( 0.5f ) ) );
+			const __m128 fraction = _mm_sub_ps( x, _mm_cvtepi32_ps( integer ) );
+			const __m128 integerPart = _mm_castsi128_ps( _mm_slli_epi32( _mm_add_epi32( integer, _mm_set1_epi32( 127 ) ), 23 ) );
+			__m128 p = _mm_set1_ps( 1.8775767e-3f );
+			p = madd( p, fraction, _mm_set1_ps( 8.9893397e-3f ) );
+			p = madd( p, fraction, _mm_set1_ps( 5.5826318e-2f ) );
+			p = madd( p, fraction, _mm_set1_ps( 2.4015361e-1f ) );
+			p = madd( p, fraction, _mm_set1_ps( 6.9315308e-1f ) );
+			p = madd( p, fraction, _mm_set1_ps( 9.9999994e-1f ) );
+			return _mm_mul_ps( integerPart, p );
+		}
+		static Type pow( Type base, Type exponent ) { return exp2( _mm_mul_ps( exponent, log2( base ) ) ); }
+		static void loadRgb( const float *rgba, Type &r, Type &g, Type &b )
+		{
+			__m128 t0 = _mm_loadu_ps( rgba );
+			__m128 t1 = _mm_loadu_ps( rgba + 4 );
+			__m128 t2 = _mm_loadu_ps( rgba + 8 );
+			__m128 t3 = _mm_loadu_ps( rgba + 12 );
+			_MM_TRANSPOSE4_PS( t0, t1, t2, t3 );
+			r = t0;
+			g = t1;
+			b = t2;
+		}
+		static double sum( Type a )
+		{
+			float values[4];
+			_mm_storeu_ps( values, a );
+			return (double) values[0] + values[1] + values[2] + values[3];
+		}
+	};
+#elif defined( CMFT_SIMD_AVX2 )
+	struct SimdPack {
+		static const size_t Width = 8;
+		typedef __m256 Type;
+
+		static Type zero() { return _mm256_setzero_ps(); }
+		static Type set1( float value ) { return _mm256_set1_ps( value ); }
+		static Type load( const float *ptr ) { return _mm256_loadu_ps( ptr ); }
+		static Type add( Type a, Type b ) { return _mm256_add_ps( a, b ); }
+		static Type sub( Type a, Type b ) { return _mm256_sub_ps( a, b ); }
+		static Type mul( Type a, Type b ) { return _mm256_mul_ps( a, b ); }
+	#if defined( __FMA__ )
+		static Type madd( Type a, Type b, Type c ) { return _mm256_fmadd_ps( a, b, c ); }
+	#else
+		static Type madd( Type a, Type b, Type c ) { return _mm256_add_ps( _mm256_mul_ps( a, b ), c ); }
+	#endif
+		static Type maskGreater( Type a, Type b, Type value ) { return _mm256_and_ps( _mm256_cmp_ps( a, b, _CMP_GT_OQ ), value ); }
+		// same approximations as the sse2 version
+		static Type log2( Type x )
+		{
+			const __m256i bits = _mm256_castps_si256( x );
+			__m256 exponent = _mm256_cvtepi32_ps( _mm256_sub_epi32( _mm256_srli_epi32( _mm256_and_si256( bits, _mm256_set1_epi32( 0x7F800000 ) ), 23 ), _mm256_set1_epi32( 127 ) ) );
+			__m256 mantissa = _mm256_or_ps( _mm256_castsi256_ps( _mm256_and_si256( bits, _mm256_set1_epi32( 0x007FFFFF ) ) ), _mm256_set1_ps( 1.0f ) );
+			const __m256 large = _mm256_cmp_ps( mantissa, _mm256_set1_ps( 1.41421356f ), _CMP_GT_OQ );
+			mantissa = _mm256_blendv_ps( mantissa, _mm256_mul_ps( mantissa, _mm256_set1_ps( 0.5f ) ), large );
+			exponent = _mm256_add_ps( exponent, _mm256_and_ps( large, _mm256_set1_ps( 1.0f ) ) );
+
+			const __m256 s = _mm256_div_ps( _mm256_sub_ps( mantissa, _mm256_set1_ps( 1.0f ) ), _mm256_add_ps( mantissa, _mm256_set1_ps( 1.0f ) ) );
+			const __m256 s2 = _mm256_mul_ps( s, s );
+			__m256 p = _mm256_set1_ps( 1.0f / 9.0f );
+			p = madd( p, s2, _mm256_set1_ps( 1.0f / 7.0f ) );
+			p = madd( p, s2, _mm256_set1_ps( 1.0f / 5.0f ) );
+			p = madd( p, s2, _mm256_set1_ps( 1.0f / 3.0f ) );
+			p = madd( p, s2, _mm256_set1_ps( 1.0f ) );
+			return madd( _mm256_mul_ps( s, p ), _mm256_set1_ps( 2.0f * 1.44269504f ), exponent );
+		}
+		static Type exp2( Type x )
+		{
+			x = _mm256_max_ps( _mm256_min_ps( x, _mm256_set1_ps( 129.0f ) ), _mm256_set1_ps( -126.99999f ) );
+			const __m256i integer = _mm256_cvtps_epi32( _mm256_sub_ps( x, _mm256_set1_ps( 0.5f ) ) );
+			const __m256 fraction = _mm256_sub_ps( x, _mm256_cvtepi32_ps( integer ) );
+			const __m256 integerPart = _mm256_castsi256_ps( _mm256_slli_epi32( _mm256_add_epi32( integer, _mm256_set1_epi32( 127 ) ), 23 ) );
+			__m256 p = _mm256_set1_ps( 1.8775767e-3f );
+			p = madd( p, fraction, _mm256_set1_ps( 8.9893397e-3f ) );
+			p = madd( p, fraction, _mm256_set1_ps( 5.5826318e-2f ) );
+			p = madd( p, fraction, _mm256_set1_ps( 2.4015361e-1f ) );
+			p = madd( p, fraction, _mm256_set1_ps( 6.9315308e-1f ) );
+			p = madd( p, fraction, _mm256_set1_ps( 9.9999994e-1f ) );
+			return _mm256_mul_ps( integerPart, p );
+		}
+		static Type pow( Type base, Type exponent ) { return exp2( _mm256_mul_ps( exponent, log2( base ) ) ); }
+		static void loadRgb( const float *rgba, Type &r, Type &g, Type &b )
+		{
+			// texels n and n + 4 share a register so that the in-lane transpose keeps them in order
+			__m256 t0 = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( rgba ) ), _mm_loadu_ps( rgba + 16 ), 1 );
+			__m256 t1 = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( rgba + 4 ) ), _mm_loadu_ps( rgba + 20 ), 1 );
+			__m256 t2 = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( rgba + 8 ) ), _mm_loadu_ps( rgba + 24 ), 1 );
+			__m256 t3 = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( rgba + 12 ) ), _mm_loadu_ps( rgba + 28 ), 1 );
+			__m256 rg01 = _mm256_unpacklo_ps( t0, t1 );
+			__m256 rg23 = _mm256_unpacklo_ps( t2, t3 );
+			__m256 ba01 = _mm256_unpackhi_ps( t0, t1 );
+			__m256 ba23 = _mm256_unpackhi_ps( t2, t3 );
+			r = _mm256_shuffle_ps( rg01, rg23, _MM_SHUFFLE( 1, 0, 1, 0 ) );
+			g = _mm256_shuffle_ps( rg01, rg23, _MM_SHUFFLE( 3, 2, 3, 2 ) );
+			b = _mm256_shuffle_ps( ba01, ba23, _MM_SHUFFLE( 1, 0, 1, 0 ) );
+		}
+		static double sum( Type a )
+		{
+			float values[8];
+			_mm256_storeu_ps( values, a );
+			double result = 0.0;
+			for( int i = 0; i < 8; ++i ) {
+				result += values[i];
+			}
+			return result;
+		}
+	};
+#else
+	typedef ScalarPack SimdPack;
+#endif
+
+	// real spherical harmonics basis constants
+	const float SH_C0 = 0.282094792f;
+	const float SH_C1 = 0.488602512f;
+	const float SH_C2 = 1.092548431f;
+	const float SH_C3 = 0.315391565f;
+	const float SH_C4 = 0.546274215f;
+
+	// number of doubles accumulated per row, 9 rgb coefficients and the total weight
+	const size_t SH_ACCUM_NUM = SH_COEFF_NUM * 3 + 1;
+
+	template<typename Pack>
+	void projectShRow( const float *rgba, const float *u, const float *v, const float *w, const float *solidAngle, size_t count, const FaceBasis &basis, double *output )
+	{
+		typedef typename Pack::Type T;
+
+		const float *axes[3] = { u, v, w };
+		const float *ax = axes[basis.mAxis[0]], *ay = axes[basis.mAxis[1]], *az = axes[basis.mAxis[2]];
+		const T sx = Pack::set1( basis.mSign[0] ), sy = Pack::set1( basis.mSign[1] ), sz = Pack::set1( basis.mSign[2] );
+		const T c0 = Pack::set1( SH_C0 ), c1 = Pack::set1( SH_C1 ), nc1 = Pack::set1( -SH_C1 ), c2 = Pack::set1( SH_C2 ), nc2 = Pack::set1( -SH_C2 );
+		const T c3 = Pack::set1( SH_C3 ), c4 = Pack::set1( SH_C4 ), three = Pack::set1( 3.0f ), one = Pack::set1( 1.0f );
+
+		T accum[SH_ACCUM_NUM];
+		for( size_t k = 0; k < SH_ACCUM_NUM; ++k ) {
+			accum[k] = Pack::zero();
+		}
+
+		size_t i = 0;
+		for( ; i + Pack::Width <= count; i += Pack::Width ) {
+			const T x = Pack::mul( Pack::load( ax + i ), sx );
+			const T y = Pack::mul( Pack::load( ay + i ), sy );
+			const T z = Pack::mul( Pack::load( az + i ), sz );
+			const T weight = Pack::load( solidAngle + i );
+
+			T r, g, b;
+			Pack::loadRgb( rgba + i * 4, r, g, b );
+			r = Pack::mul( r, weight );
+			g = Pack::mul( g, weight );
+			b = Pack::mul( b, weight );
+
+			const T sh[SH_COEFF_NUM] = {
+				c0,
+				Pack::mul( nc1, y ),
+				Pack::mul( c1, z ),
+				Pack::mul( nc1, x ),
+				Pack::mul( c2, Pack::mul( x, y ) ),
+				Pack::mul( nc2, Pack::mul( y, z ) ),
+				Pack::mul( c3, Pack::sub( Pack::mul( three, Pack::mul( z, z ) ), one ) ),
+				Pack::mul( nc2, Pack::mul( x, z ) ),
+				Pack::mul( c4, Pack::sub( Pack::mul( x, x ), Pack::mul( y, y ) ) )
+			};
+			for( size_t k = 0; k < SH_COEFF_NUM; ++k ) {
+				accum[k * 3 + 0] = Pack::madd( sh[k], r, accum[k * 3 + 0] );
+				accum[k * 3 + 1] = Pack::madd( sh[k], g, accum[k * 3 + 1] );
+				accum[k * 3 + 2] = Pack::madd( sh[k], b, accum[k * 3 + 2] );
+			}
+			accum[SH_ACCUM_NUM - 1] = Pack::add( accum[SH_ACCUM_NUM - 1], weight );
+		}
+
+		for( size_t k = 0; k < SH_ACCUM_NUM; ++k ) {
+			output[k] += Pack::sum( accum[k] );
+		}
+
+		// remaining texels that don't fill a whole register
+		if( i < count ) {
+			projectShRow<ScalarPack>( rgba + i * 4, u + i, v + i, w + i, solidAngle + i, count - i, basis, output );
+		}
+	}
+}
+
+const char* getSimdName()
+{
+#if defined( CMFT_SIMD_AVX2 )
+	return "avx2";
+#elif defined( CMFT_SIMD_SSE2 )
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+namespace {
+	// output texels are filtered in square tiles sharing the same list of source blocks
+	const uint32_t RADIANCE_TILE_SIZE = 8;
+	const uint32_t RADIANCE_TILE_TEXELS = RADIANCE_TILE_SIZE * RADIANCE_TILE_SIZE;
+	// source blocks are small enough to stay in the l1 cache while a tile is processed
+	const uint32_t RADIANCE_BLOCK_SIZE = 16;
+	// block stride is a multiple of the widest simd pack
+	const uint32_t RADIANCE_BLOCK_ALIGN = 8;
+
+	const float PI = 3.14159265358979323846f;
+
+	float clampedAcos( float x )
+	{
+		return std::acos( std::max( -1.0f, std::min( 1.0f, x ) ) );
+	}
+
+	float dot( const float *a, const float *b )
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	void normalize( float *v )
+	{
+		const float length = std::sqrt( dot( v, v ) );
+		if( length > 0.0f ) {
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		}
+	}
+
+	// calls func( index in block, face, x, y ) for every texel of \a block
+	template<typename Func>
+	void forEachBlockTexel( const SourceBlocks &blocks, size_t block, const Func &func )
+	{
+		const size_t blocksPerFace = blocks.mBlocksPerRow * blocks.mBlocksPerRow;
+		const uint8_t face = static_cast<uint8_t>( block / blocksPerFace );
+		const uint32_t x0 = static_cast<uint32_t>( block % blocks.mBlocksPerRow ) * blocks.mBlockSize;
+		const uint32_t y0 = static_cast<uint32_t>( ( block % blocksPerFace ) / blocks.mBlocksPerRow ) * blocks.mBlockSize;
+		const uint32_t x1 = std::min( x0 + blocks.mBlockSize, blocks.mFaceSize );
+		const uint32_t y1 = std::min( y0 + blocks.mBlockSize, blocks.mFaceSize );
+
+		size_t index = 0;
+		for( uint32_t y = y0; y < y1; ++y ) {
+			for( uint32_t x = x0; x < x1; ++x ) {
+				func( index++, face, x, y );
+			}
+		}
+	}
+
+	// world space direction of the texel ( x, y ) of a face of size faceSize
+	void getTexelDirection( uint8_t face, uint32_t x, uint32_t y, uint32_t faceSize, bool warpFixup, float *dir )
+	{
+		float u, v;
+		if( warpFixup && faceSize > 1 ) {
+			// same warp as cmft's EdgeFixup::Warp, the edge texels are pushed onto the face edges
+			const float size = static_cast<float>( faceSize );
+			const float warp = ( size * size ) / ( ( size - 1.0f ) * ( size - 1.0f ) * ( size - 1.0f ) );
+			u = 2.0f * x / ( size - 1.0f ) - 1.0f;
+			v = 2.0f * y / ( size - 1.0f ) - 1.0f;
+			u = warp * u * u * u + u;
+			v = warp * v * v * v + v;
+		}
+		else {
+			u = 2.0f * ( x + 0.5f ) / faceSize - 1.0f;
+			v = 2.0f * ( y + 0.5f ) / faceSize - 1.0f;
+		}
+
+		const float invLength = 1.0f / std::sqrt( u * u + v * v + 1.0f );
+		const float uvw[3] = { u * invLength, v * invLength, invLength };
+		const FaceBasis &basis = getFaceBasis( face );
+		for( int i = 0; i < 3; ++i ) {
+			dir[i] = uvw[basis.mAxis[i]] * basis.mSign[i];
+		}
+	}
+
+	struct RadianceTile {
+		uint8_t		mMip, mFace;
+		uint32_t	mX, mY;
+	};
+
+	struct RadianceSource {
+		const SourceBlocks	*mBlocks;
+		const float			*mRed, *mGreen, *mBlue;
+	};
+
+	// per thread memory reused by the tiles, so that filtering a tile doesn't allocate once the vectors have grown
+	struct RadianceScratch {
+		std::vector<uint32_t>	mCandidates;
+		std::vector<float>		mMinCosines;
+	};
+
+	template<typename Pack>
+	void filterRadianceTile( const RadianceTile &tile, const RadianceSource &source, float specularPower, float filterAngle, bool warpFixup, uint32_t mipSize, float *outputFace, RadianceScratch &scratch )
+	{
+		typedef typename Pack::Type T;
+		const SourceBlocks &blocks = *source.mBlocks;
+		const size_t stride = blocks.mBlockStride;
+
+		// output directions and their bounding cone
+		const uint32_t width = std::min( RADIANCE_TILE_SIZE, mipSize - tile.mX );
+		const uint32_t height = std::min( RADIANCE_TILE_SIZE, mipSize - tile.mY );
+		const uint32_t numTexels = width * height;
+		float dirs[RADIANCE_TILE_TEXELS][3];
+		float center[3] = { 0.0f, 0.0f, 0.0f };
+		for( uint32_t i = 0; i < numTexels; ++i ) {
+			getTexelDirection( tile.mFace, tile.mX + i % width, tile.mY + i / width, mipSize, warpFixup, dirs[i] );
+			center[0] += dirs[i][0];
+			center[1] += dirs[i][1];
+			center[2] += dirs[i][2];
+		}
+		normalize( center );
+		float tileRadius = 0.0f;
+		for( uint32_t i = 0; i < numTexels; ++i ) {
+			tileRadius = std::max( tileRadius, clampedAcos( dot( center, dirs[i] ) ) );
+		}
+
+		// source blocks reachable from at least one texel of the tile, and the cone each texel has to be in to reach them
+		const float epsilon = 1e-4f;
+		std::vector<uint32_t> &candidates = scratch.mCandidates;
+		std::vector<float> &minCosines = scratch.mMinCosines;
+		candidates.clear();
+		minCosines.clear();
+		const size_t numBlocks = blocks.mRadii.size();
+		for( size_t block = 0; block < numBlocks; ++block ) {
+			const float reach = filterAngle + blocks.mRadii[block] + epsilon;
+			if( clampedAcos( dot( center, &blocks.mCenters[block * 3] ) ) <= reach + tileRadius ) {
+				candidates.push_back( static_cast<uint32_t>( block ) );
+				minCosines.push_back( reach >= PI ? -2.0f : std::cos( reach ) );
+			}
+		}
+
+		T accum[RADIANCE_TILE_TEXELS][4];
+		for( uint32_t i = 0; i < numTexels; ++i ) {
+			accum[i][0] = accum[i][1] = accum[i][2] = accum[i][3] = Pack::zero();
+		}
+
+		const T power = Pack::set1( specularPower );
+		const T threshold = Pack::set1( std::cos( filterAngle ) );
+		for( size_t c = 0; c < candidates.size(); ++c ) {
+			const size_t block = candidates[c];
+			const float *blockCenter = &blocks.mCenters[block * 3];
+			const float *x = &blocks.mX[block * stride], *y = &blocks.mY[block * stride], *z = &blocks.mZ[block * stride];
+			const float *solidAngle = &blocks.mSolidAngle[block * stride];
+			const float *red = source.mRed + block * stride, *green = source.mGreen + block * stride, *blue = source.mBlue + block * stride;
+
+			for( uint32_t i = 0; i < numTexels; ++i ) {
+				if( dot( dirs[i], blockCenter ) < minCosines[c] ) {
+					continue;
+				}
+
+				const T nx = Pack::set1( dirs[i][0] ), ny = Pack::set1( dirs[i][1] ), nz = Pack::set1( dirs[i][2] );
+				T r = accum[i][0], g = accum[i][1], b = accum[i][2], weights = accum[i][3];
+				for( size_t k = 0; k < stride; k += Pack::Width ) {
+					const T cosine = Pack::madd( nx, Pack::load( x + k ), Pack::madd( ny, Pack::load( y + k ), Pack::mul( nz, Pack::load( z + k ) ) ) );
+					const T weight = Pack::mul( Pack::maskGreater( cosine, threshold, Pack::pow( cosine, power ) ), Pack::load( solidAngle + k ) );
+					r = Pack::madd( weight, Pack::load( red + k ), r );
+					g = Pack::madd( weight, Pack::load( green + k ), g );
+					b = Pack::madd( weight, Pack::load( blue + k ), b );
+					weights = Pack::add( weights, weight );
+				}
+				accum[i][0] = r;
+				accum[i][1] = g;
+				accum[i][2] = b;
+				accum[i][3] = weights;
+			}
+		}
+
+		// normalize by the total weight
+		for( uint32_t i = 0; i < numTexels; ++i ) {
+			const double weights = Pack::sum( accum[i][3] );
+			const double norm = weights > 0.0 ? 1.0 / weights : 0.0;
+			float *rgba = outputFace + ( ( tile.mY + i / width ) * mipSize + tile.mX + i % width ) * 4;
+			rgba[0] = static_cast<float>( Pack::sum( accum[i][0] ) * norm );
+			rgba[1] = static_cast<float>( Pack::sum( accum[i][1] ) * norm );
+			rgba[2] = static_cast<float>( Pack::sum( accum[i][2] ) * norm );
+			rgba[3] = 1.0f;
+		}
+	}
+}
+
+std::shared_ptr<const SourceBlocks> createSourceBlocks( uint32_t faceSize )
+{
+	auto blocks = std::make_shared<SourceBlocks>();
+	auto table = getCubemapTable( faceSize );
+
+	blocks->mFaceSize = faceSize;
+	blocks->mBlockSize = std::min( faceSize, RADIANCE_BLOCK_SIZE );
+	blocks->mBlocksPerRow = ( faceSize + blocks->mBlockSize - 1 ) / blocks->mBlockSize;
+	blocks->mBlockStride = ( blocks->mBlockSize * blocks->mBlockSize + RADIANCE_BLOCK_ALIGN - 1 ) / RADIANCE_BLOCK_ALIGN * RADIANCE_BLOCK_ALIGN;
+
+	const size_t numBlocks = CUBE_FACE_NUM * blocks->mBlocksPerRow * blocks->mBlocksPerRow;
+	const size_t numValues = numBlocks * blocks->mBlockStride;
+	blocks->mX.resize( numValues, 0.0f );
+	blocks->mY.resize( numValues, 0.0f );
+	blocks->mZ.resize( numValues, 0.0f );
+	blocks->mSolidAngle.resize( numValues, 0.0f );
+	blocks->mCenters.resize( numBlocks * 3 );
+	blocks->mRadii.resize( numBlocks );
+
+	parallelFor( numBlocks, [&]( size_t block ) {
+		const size_t base = block * blocks->mBlockStride;
+		float *center = &blocks->mCenters[block * 3];
+		center[0] = center[1] = center[2] = 0.0f;
+
+		forEachBlockTexel( *blocks, block, [&]( size_t index, uint8_t face, uint32_t x, uint32_t y ) {
+			const size_t texel = y * faceSize + x;
+			const float uvw[3] = { table->mU[texel], table->mV[texel], table->mW[texel] };
+			const FaceBasis &basis = getFaceBasis( face );
+			const float dir[3] = { uvw[basis.mAxis[0]] * basis.mSign[0], uvw[basis.mAxis[1]] * basis.mSign[1], uvw[basis.mAxis[2]] * basis.mSign[2] };
+			blocks->mX[base + index] = dir[0];
+			blocks->mY[base + index] = dir[1];
+			blocks->mZ[base + index] = dir[2];
+			blocks->mSolidAngle[base + index] = table->mSolidAngle[texel];
+			center[0] += dir[0];
+			center[1] += dir[1];
+			center[2] += dir[2];
+		} );
+		normalize( center );
+
+		float radius = 0.0f;
+		forEachBlockTexel( *blocks, block, [&]( size_t index, uint8_t, uint32_t, uint32_t ) {
+			const float dir[3] = { blocks->mX[base + index], blocks->mY[base + index], blocks->mZ[base + index] };
+			radius = std::max( radius, clampedAcos( dot( center, dir ) ) );
+		} );
+		blocks->mRadii[block] = radius;
+	} );
+
+	return blocks;
+}
+
+uint8_t getSourceLevel( uint32_t faceSize, uint8_t mip, float specularPower )
+{
+	// cos( angle ) ^ power is close to a gaussian of deviation 1 / sqrt( power ), which needs about three texels to be resolved
+	const float deviation = 1.0f / std::sqrt( std::max( specularPower, 1.0f ) );
+	const uint32_t mipSize = std::max( 1u, faceSize >> mip );
+
+	// never go under the output resolution
+	uint8_t level = 0;
+	while( ( faceSize >> ( level + 1 ) ) >= mipSize ) {
+		const float texelAngle = 0.5f * PI / static_cast<float>( faceSize >> ( level + 1 ) );
+		if( texelAngle > deviation / 3.0f ) {
+			break;
+		}
+		++level;
+	}
+	return level;
+}
+
+void radianceFilter( Image &output, const SourcePyramid &pyramid, const std::vector<std::shared_ptr<const SourceBlocks>> &levelBlocks, const uint8_t *sourceLevels, const float *specularPowers, const float *filterAngles, uint8_t mipCount, bool excludeBase, bool warpFixup, uint32_t numThreads )
+{
+	const uint32_t faceSize = pyramid.mFaceSize;
+	const uint8_t firstMip = excludeBase ? 1 : 0;
+
+	// gather the colors of every source level in use in its block layout
+	std::vector<RadianceSource> sources( pyramid.mLevels.size(), RadianceSource{ nullptr, nullptr, nullptr, nullptr } );
+	std::vector<std::vector<float>> channels( pyramid.mLevels.size() * 3 );
+	for( uint8_t mip = firstMip; mip < mipCount; ++mip ) {
+		const uint8_t level = sourceLevels[mip];
+		if( sources[level].mBlocks ) {
+			continue;
+		}
+
+		const SourceBlocks &blocks = *levelBlocks[level];
+		const size_t numBlocks = blocks.mRadii.size();
+		const size_t stride = blocks.mBlockStride;
+		const uint32_t levelSize = blocks.mFaceSize;
+		const float *levelData = pyramid.mLevels[level].data();
+		std::vector<float> &red = channels[level * 3], &green = channels[level * 3 + 1], &blue = channels[level * 3 + 2];
+		red.assign( numBlocks * stride, 0.0f );
+		green.assign( numBlocks * stride, 0.0f );
+		blue.assign( numBlocks * stride, 0.0f );
+		parallelFor( numBlocks, [&]( size_t block ) {
+			forEachBlockTexel( blocks, block, [&]( size_t index, uint8_t face, uint32_t x, uint32_t y ) {
+				const float *rgba = levelData + ( ( static_cast<size_t>( face ) * levelSize + y ) * levelSize + x ) * 4;
+				red[block * stride + index] = rgba[0];
+				green[block * stride + index] = rgba[1];
+				blue[block * stride + index] = rgba[2];
+			} );
+		}, numThreads );
+		sources[level] = { &blocks, red.data(), green.data(), blue.data() };
+	}
+
+	imageCreate( output, faceSize, faceSize, 0x0, mipCount, CUBE_FACE_NUM, TextureFormat::RGBA32F );
+	uint32_t outputOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+	imageGetMipOffsets( outputOffsets, output );
+
+	// the base level is left untouched when excluded
+	if( excludeBase ) {
+		const float *src = pyramid.mLevels[0].data();
+		for( uint8_t face = 0; face < CUBE_FACE_NUM; ++face ) {
+			float *rgba = reinterpret_cast<float*>( static_cast<uint8_t*>( output.m_data ) + outputOffsets[face][0] );
+			for( size_t i = 0, numTexels = static_cast<size_t>( faceSize ) * faceSize; i < numTexels; ++i, rgba += 4, src += 4 ) {
+				rgba[0] = src[0];
+				rgba[1] = src[1];
+				rgba[2] = src[2];
+				rgba[3] = 1.0f;
+			}
+		}
+	}
+
+	// one task per output tile of every filtered mip
+	std::vector<RadianceTile> tiles;
+	for( uint8_t mip = firstMip; mip < mipCount; ++mip ) {
+		const uint32_t mipSize = std::max( 1u, faceSize >> mip );
+		for( uint8_t face = 0; face < CUBE_FACE_NUM; ++face ) {
+			for( uint32_t y = 0; y < mipSize; y += RADIANCE_TILE_SIZE ) {
+				for( uint32_t x = 0; x < mipSize; x += RADIANCE_TILE_SIZE ) {
+					tiles.push_back( { mip, face, x, y } );
+				}
+			}
+		}
+	}
+
+	std::vector<RadianceScratch> scratch( getParallelForSlotCount( tiles.size(), numThreads ) );
+	parallelForSlots( tiles.size(), [&]( size_t index, size_t slot ) {
+		const RadianceTile &tile = tiles[index];
+		const uint32_t mipSize = std::max( 1u, faceSize >> tile.mMip );
+		float *outputFace = reinterpret_cast<float*>( static_cast<uint8_t*>( output.m_data ) + outputOffsets[tile.mFace][tile.mMip] );
+		filterRadianceTile<SimdPack>( tile, sources[sourceLevels[tile.mMip]], specularPowers[tile.mMip], filterAngles[tile.mMip], warpFixup, mipSize, outputFace, scratch[slot] );
+	}, numThreads );
+}
+
+void buildSourcePyramid( SourcePyramid &pyramid, const Image &input, uint32_t numThreads )
+{
+	const uint32_t faceSize = input.m_width;
+	pyramid.mFaceSize = faceSize;
+	pyramid.mLevels.clear();
+
+	// first level is a copy of the input first mip
+	uint32_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+	imageGetMipOffsets( offsets, input );
+	const size_t faceValues = static_cast<size_t>( faceSize ) * faceSize * 4;
+	pyramid.mLevels.emplace_back( CUBE_FACE_NUM * faceValues );
+	for( uint8_t face = 0; face < CUBE_FACE_NUM; ++face ) {
+		const float *src = reinterpret_cast<const float*>( static_cast<const uint8_t*>( input.m_data ) + offsets[face][0] );
+		std::copy( src, src + faceValues, pyramid.mLevels[0].begin() + face * faceValues );
+	}
+
+	// then average 2x2 texels down to a single one
+	for( uint32_t srcSize = faceSize; srcSize > 1; srcSize = std::max( 1u, srcSize / 2 ) ) {
+		const uint32_t dstSize = std::max( 1u, srcSize / 2 );
+		const std::vector<float> &src = pyramid.mLevels.back();
+		std::vector<float> dst( CUBE_FACE_NUM * static_cast<size_t>( dstSize ) * dstSize * 4 );
+		parallelFor( CUBE_FACE_NUM * static_cast<size_t>( dstSize ), [&]( size_t row ) {
+			const size_t face = row / dstSize;
+			const uint32_t y = static_cast<uint32_t>( row % dstSize );
+			const float *srcFace = &src[face * srcSize * srcSize * 4];
+			float *rgba = &dst[( face * dstSize * dstSize + y * dstSize ) * 4];
+			for( uint32_t x = 0; x < dstSize; ++x, rgba += 4 ) {
+				const uint32_t x0 = std::min( x * 2, srcSize - 1 ), x1 = std::min( x * 2 + 1, srcSize - 1 );
+				const uint32_t y0 = std::min( y * 2, srcSize - 1 ), y1 = std::min( y * 2 + 1, srcSize - 1 );
+				for( int c = 0; c < 4; ++c ) {
+					rgba[c] = 0.25f * ( srcFace[( y0 * srcSize + x0 ) * 4 + c] + srcFace[( y0 * srcSize + x1 ) * 4 + c] + srcFace[( y1 * srcSize + x0 ) * 4 + c] + srcFace[( y1 * srcSize + x1 ) * 4 + c] );
+				}
+			}
+		}, numThreads );
+		pyramid.mLevels.push_back( std::move( dst ) );
+	}
+}
+
+namespace {
+	// inverse of the face bases, returns the face and the face space coordinates in [-1, 1]
+	uint8_t getFaceCoordinates( const float *dir, float &u, float &v )
+	{
+		const float ax = std::abs( dir[0] ), ay = std::abs( dir[1] ), az = std::abs( dir[2] );
+		if( ax >= ay && ax >= az ) {
+			u = ( dir[0] > 0.0f ? -dir[2] : dir[2] ) / ax;
+			v = -dir[1] / ax;
+			return dir[0] > 0.0f ? 0 : 1;
+		}
+		else if( ay >= az ) {
+			u = dir[0] / ay;
+			v = ( dir[1] > 0.0f ? dir[2] : -dir[2] ) / ay;
+			return dir[1] > 0.0f ? 2 : 3;
+		}
+		else {
+			u = ( dir[2] > 0.0f ? dir[0] : -dir[0] ) / az;
+			v = -dir[1] / az;
+			return dir[2] > 0.0f ? 4 : 5;
+		}
+	}
+
+	// bilinear lookup, clamped to the face edges
+	void sampleFace( const float *face, uint32_t faceSize, float u, float v, float weight, float *rgb )
+	{
+		const float fx = std::max( 0.0f, std::min( ( u + 1.0f ) * 0.5f * faceSize - 0.5f, faceSize - 1.0f ) );
+		const float fy = std::max( 0.0f, std::min( ( v + 1.0f ) * 0.5f * faceSize - 0.5f, faceSize - 1.0f ) );
+		const uint32_t x0 = static_cast<uint32_t>( fx ), y0 = static_cast<uint32_t>( fy );
+		const uint32_t x1 = std::min( x0 + 1, faceSize - 1 ), y1 = std::min( y0 + 1, faceSize - 1 );
+		const float tx = fx - x0, ty = fy - y0;
+
+		const float *t00 = face + ( y0 * faceSize + x0 ) * 4, *t10 = face + ( y0 * faceSize + x1 ) * 4;
+		const float *t01 = face + ( y1 * faceSize + x0 ) * 4, *t11 = face + ( y1 * faceSize + x1 ) * 4;
+		for( int c = 0; c < 3; ++c ) {
+			const float top = t00[c] + ( t10[c] - t00[c] ) * tx;
+			const float bottom = t01[c] + ( t11[c] - t01[c] ) * tx;
+			rgb[c] += weight * ( top + ( bottom - top ) * ty );
+		}
+	}
+
+	float radicalInverse( uint32_t bits )
+	{
+		bits = ( bits << 16u ) | ( bits >> 16u );
+		bits = ( ( bits & 0x55555555u ) << 1u ) | ( ( bits & 0xAAAAAAAAu ) >> 1u );
+		bits = ( ( bits & 0x33333333u ) << 2u ) | ( ( bits & 0xCCCCCCCCu ) >> 2u );
+		bits = ( ( bits & 0x0F0F0F0Fu ) << 4u ) | ( ( bits & 0xF0F0F0F0u ) >> 4u );
+		bits = ( ( bits & 0x00FF00FFu ) << 8u ) | ( ( bits & 0xFF00FF00u ) >> 8u );
+		return static_cast<float>( bits ) * 2.3283064365386963e-10f;
+	}
+}
+
+void sampleSourcePyramid( const SourcePyramid &pyramid, const float *dir, float level, float *rgb )
+{
+	float u, v;
+	const uint8_t face = getFaceCoordinates( dir, u, v );
+
+	level = std::max( 0.0f, std::min( level, static_cast<float>( pyramid.mLevels.size() - 1 ) ) );
+	const uint32_t level0 = static_cast<uint32_t>( level );
+	const uint32_t level1 = std::min<uint32_t>( level0 + 1, static_cast<uint32_t>( pyramid.mLevels.size() - 1 ) );
+	const float t = level - level0;
+
+	rgb[0] = rgb[1] = rgb[2] = 0.0f;
+	const uint32_t size0 = std::max( 1u, pyramid.mFaceSize >> level0 );
+	sampleFace( &pyramid.mLevels[level0][face * size0 * size0 * 4], size0, u, v, 1.0f - t, rgb );
+	if( t > 0.0f ) {
+		const uint32_t size1 = std::max( 1u, pyramid.mFaceSize >> level1 );
+		sampleFace( &pyramid.mLevels[level1][face * size1 * size1 * 4], size1, u, v, t, rgb );
+	}
+}
+
+std::shared_ptr<const GgxLobes> createGgxLobes( uint32_t faceSize, uint8_t mipCount, uint32_t sampleCount )
+{
+	auto lobes = std::make_shared<GgxLobes>();
+	lobes->mFaceSize = faceSize;
+	lobes->mSamples.resize( mipCount );
+
+	// solid angle of a source texel
+	const float texelSolidAngle = 4.0f * PI / ( CUBE_FACE_NUM * static_cast<float>( faceSize ) * faceSize );
+
+	// the first mip is a perfect mirror and keeps the source as is
+	for( uint8_t mip = 1; mip < mipCount; ++mip ) {
+		const float roughness = static_cast<float>( mip ) / static_cast<float>( mipCount - 1 );
+		const float alpha = roughness * roughness;
+		const float alpha2 = alpha * alpha;
+
+		auto &samples = lobes->mSamples[mip];
+		for( uint32_t i = 0; i < sampleCount; ++i ) {
+			// hammersley point mapped to a half vector of the ggx distribution
+			const float phi = 2.0f * PI * static_cast<float>( i ) / static_cast<float>( sampleCount );
+			const float xi = radicalInverse( i );
+			const float cosTheta = std::sqrt( ( 1.0f - xi ) / ( 1.0f + ( alpha2 - 1.0f ) * xi ) );
+			const float sinTheta = std::sqrt( 1.0f - cosTheta * cosTheta );
+			const float h[3] = { sinTheta * std::cos( phi ), sinTheta * std::sin( phi ), cosTheta };
+
+			// reflect the view direction, which is the normal
+			const float l[3] = { 2.0f * cosTheta * h[0], 2.0f * cosTheta * h[1], 2.0f * cosTheta * cosTheta - 1.0f };
+			if( l[2] <= 0.0f ) {
+				continue;
+			}
+
+			// pick the source level whose texels cover the solid angle of the sample
+			const float d = cosTheta * cosTheta * ( alpha2 - 1.0f ) + 1.0f;
+			const float pdf = alpha2 / ( PI * d * d ) / 4.0f;
+			const float sampleSolidAngle = 1.0f / ( sampleCount * pdf + 1e-6f );
+			const float level = std::max( 0.0f, 0.5f * std::log2( sampleSolidAngle / texelSolidAngle ) + 1.0f );
+
+			samples.push_back( { l[0], l[1], l[2], level } );
+		}
+	}
+
+	return lobes;
+}
+
+void ggxFilter( Image &output, const Image &input, const GgxLobes &lobes, uint32_t numThreads )
+{
+	const uint32_t faceSize = lobes.mFaceSize;
+	const uint8_t mipCount = static_cast<uint8_t>( lobes.mSamples.size() );
+
+	SourcePyramid pyramid;
+	buildSourcePyramid( pyramid, input, numThreads );
+
+	imageCreate( output, faceSize, faceSize, 0x0, mipCount, CUBE_FACE_NUM, TextureFormat::RGBA32F );
+	uint32_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+	imageGetMipOffsets( offsets, output );
+
+	// one task per row of every mip
+	std::vector<std::pair<uint8_t, uint32_t>> rows;
+	for( uint8_t mip = 0; mip < mipCount; ++mip ) {
+		const uint32_t mipSize = std::max( 1u, faceSize >> mip );
+		for( uint32_t row = 0; row < CUBE_FACE_NUM * mipSize; ++row ) {
+			rows.push_back( std::make_pair( mip, row ) );
+		}
+	}
+
+	parallelFor( rows.size(), [&]( size_t index ) {
+		const uint8_t mip = rows[index].first;
+		const uint32_t mipSize = std::max( 1u, faceSize >> mip );
+		const uint8_t face = static_cast<uint8_t>( rows[index].second / mipSize );
+		const uint32_t y = rows[index].second % mipSize;
+		const auto &samples = lobes.mSamples[mip];
+		float *rgba = reinterpret_cast<float*>( static_cast<uint8_t*>( output.m_data ) + offsets[face][mip] ) + static_cast<size_t>( y ) * mipSize * 4;
+
+		for( uint32_t x = 0; x < mipSize; ++x, rgba += 4 ) {
+			float n[3];
+			getTexelDirection( face, x, y, mipSize, false, n );
+			rgba[3] = 1.0f;
+
+			// mirror lobe, lookup the source
+			if( samples.empty() ) {
+				sampleSourcePyramid( pyramid, n, 0.0f, rgba );
+				continue;
+			}
+
+			// tangent frame around the normal
+			const float up[3] = { std::abs( n[2] ) < 0.999f ? 0.0f : 1.0f, 0.0f, std::abs( n[2] ) < 0.999f ? 1.0f : 0.0f };
+			float tangent[3] = { up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0] };
+			normalize( tangent );
+			const float bitangent[3] = { n[1] * tangent[2] - n[2] * tangent[1], n[2] * tangent[0] - n[0] * tangent[2], n[0] * tangent[1] - n[1] * tangent[0] };
+
+			float sum[3] = { 0.0f, 0.0f, 0.0f }, weights = 0.0f;
+			for( const auto &sample : samples ) {
+				const float l[3] = {
+					tangent[0] * sample.mX + bitangent[0] * sample.mY + n[0] * sample.mZ,
+					tangent[1] * sample.mX + bitangent[1] * sample.mY + n[1] * sample.mZ,
+					tangent[2] * sample.mX + bitangent[2] * sample.mY + n[2] * sample.mZ
+				};
+				float rgb[3];
+				sampleSourcePyramid( pyramid, l, sample.mLevel, rgb );
+				sum[0] += rgb[0] * sample.mZ;
+				sum[1] += rgb[1] * sample.mZ;
+				sum[2] += rgb[2] * sample.mZ;
+				weights += sample.mZ;
+			}
+
+			const float norm = weights > 0.0f ? 1.0f / weights : 0.0f;
+			rgba[0] = sum[0] * norm;
+			rgba[1] = sum[1] * norm;
+			rgba[2] = sum[2] * norm;
+		}
+	}, numThreads );
+}
+
+void integrateBrdf( float *output, uint32_t size, uint32_t sampleCount, const std::function<float( float )> &getBlinnPower, uint32_t numThreads )
+{
+	parallelFor( size, [&]( size_t row ) {
+		const float roughness = ( row + 0.5f ) / size;
+
+		// smith visibility using schlick's approximation, the blinn-phong power going through its beckmann equivalent roughness
+		float blinnPower = 0.0f, alpha;
+		if( getBlinnPower ) {
+			blinnPower = getBlinnPower( roughness );
+			alpha = std::sqrt( 2.0f / ( blinnPower + 2.0f ) );
+		}
+		else {
+			alpha = roughness * roughness;
+		}
+		const float alpha2 = alpha * alpha;
+		const float k = alpha / 2.0f;
+
+		float *rg = output + row * size * 2;
+		for( uint32_t x = 0; x < size; ++x, rg += 2 ) {
+			const float NoV = ( x + 0.5f ) / size;
+			const float v[3] = { std::sqrt( 1.0f - NoV * NoV ), 0.0f, NoV };
+			const float visibilityV = NoV / ( NoV * ( 1.0f - k ) + k );
+
+			float scale = 0.0f, bias = 0.0f;
+			for( uint32_t i = 0; i < sampleCount; ++i ) {
+				// half vector distributed as D( h ) * NoH
+				const float phi = 2.0f * PI * static_cast<float>( i ) / static_cast<float>( sampleCount );
+				const float xi = radicalInverse( i );
+				const float cosTheta = getBlinnPower ? std::pow( 1.0f - xi, 1.0f / ( blinnPower + 2.0f ) ) : std::sqrt( ( 1.0f - xi ) / ( 1.0f + ( alpha2 - 1.0f ) * xi ) );
+				const float sinTheta = std::sqrt( std::max( 0.0f, 1.0f - cosTheta * cosTheta ) );
+				const float h[3] = { sinTheta * std::cos( phi ), sinTheta * std::sin( phi ), cosTheta };
+
+				const float VoH = dot( v, h );
+				const float NoL = 2.0f * VoH * h[2] - v[2];
+				if( NoL <= 0.0f ) {
+					continue;
+				}
+
+				// the distribution cancels with the pdf, leaving F * G * VoH / ( NoH * NoV )
+				const float visibilityL = NoL / ( NoL * ( 1.0f - k ) + k );
+				const float visibility = visibilityV * visibilityL * std::max( VoH, 0.0f ) / ( h[2] * NoV );
+				const float fresnel = std::pow( 1.0f - std::max( VoH, 0.0f ), 5.0f );
+				scale += ( 1.0f - fresnel ) * visibility;
+				bias += fresnel * visibility;
+			}
+			rg[0] = scale / sampleCount;
+			rg[1] = bias / sampleCount;
+		}
+	}, numThreads );
+}
+
+void projectSh( const Image &input, double shRgb[SH_COEFF_NUM][3] )
+{
+	const uint32_t faceSize = input.m_width;
+	auto table = getCubemapTable( faceSize );
+
+	uint32_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+	imageGetMipOffsets( offsets, input );
+
+	// one partial sum per face row, summed in order afterward so that the result doesn't depend on the threads
+	const size_t numRows = CUBE_FACE_NUM * static_cast<size_t>( faceSize );
+	std::vector<std::array<double, SH_ACCUM_NUM>> partials( numRows );
+	parallelFor( numRows, [&]( size_t row ) {
+		const uint8_t face = static_cast<uint8_t>( row / faceSize );
+		const size_t y = row % faceSize;
+		const size_t texel = y * faceSize;
+		const float *rgba = reinterpret_cast<const float*>( static_cast<const uint8_t*>( input.m_data ) + offsets[face][0] ) + texel * 4;
+
+		partials[row].fill( 0.0 );
+		projectShRow<SimdPack>( rgba, &table->mU[texel], &table->mV[texel], &table->mW[texel], &table->mSolidAngle[texel], faceSize, getFaceBasis( face ), partials[row].data() );
+	} );
+
+	double sums[SH_ACCUM_NUM] = {};
+	for( const auto &partial : partials ) {
+		for( size_t k = 0; k < SH_ACCUM_NUM; ++k ) {
+			sums[k] += partial[k];
+		}
+	}
+
+	// normalize so that the solid angles sum to exactly 4 pi
+	const double norm = sums[SH_ACCUM_NUM - 1] > 0.0 ? ( 4.0 * 3.14159265358979323846 ) / sums[SH_ACCUM_NUM - 1] : 0.0;
+	for( size_t k = 0; k < SH_COEFF_NUM; ++k ) {
+		for( size_t c = 0; c < 3; ++c ) {
+			shRgb[k][c] = sums[k * 3 + c] * norm;
+		}
+	}
+}
+
+void evaluateSh( Image &output, const CubemapTable &table, const float *coeffs )
+{
+	const uint32_t faceSize = table.mFaceSize;
+	imageCreate( output, faceSize, faceSize, 0x0, 1, CUBE_FACE_NUM, TextureFormat::RGB32F );
+
+	uint32_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+	imageGetMipOffsets( offsets, output );
+
+	parallelFor( CUBE_FACE_NUM * static_cast<size_t>( faceSize ), [&]( size_t row ) {
+		const uint8_t face = static_cast<uint8_t>( row / faceSize );
+		const size_t texelY = row % faceSize;
+		const FaceBasis &basis = getFaceBasis( face );
+		float *rgb = reinterpret_cast<float*>( static_cast<uint8_t*>( output.m_data ) + offsets[face][0] ) + texelY * faceSize * 3;
+
+		for( size_t i = texelY * faceSize, end = i + faceSize; i < end; ++i, rgb += 3 ) {
+			const float uvw[3] = { table.mU[i], table.mV[i], table.mW[i] };
+			const float x = uvw[basis.mAxis[0]] * basis.mSign[0];
+			const float y = uvw[basis.mAxis[1]] * basis.mSign[1];
+			const float z = uvw[basis.mAxis[2]] * basis.mSign[2];
+			const float sh[SH_COEFF_NUM] = {
+				SH_C0,
+				-SH_C1 * y,
+				SH_C1 * z,
+				-SH_C1 * x,
+				SH_C2 * x * y,
+				-SH_C2 * y * z,
+				SH_C3 * ( 3.0f * z * z - 1.0f ),
+				-SH_C2 * x * z,
+				SH_C4 * ( x * x - y * y )
+			};
+			for( size_t c = 0; c < 3; ++c ) {
+				float value = 0.0f;
+				for( size_t k = 0; k < SH_COEFF_NUM; ++k ) {
+					value += coeffs[k * 3 + c] * sh[k];
+				}
+				rgb[c] = std::max( value, 0.0f );
+			}
+		}
+	} );
+}
+
+} } // namespace cmft::detail
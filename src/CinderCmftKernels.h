@@ -0,0 +1,104 @@
+#pragma once
+
+#include "cmft/image.h"
+#include "cmft/cubemapfilter.h"
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace cmft { namespace detail {
+
+//! Per face size lookup table shared by the cpu filters. Only one face is stored, the other five are sign / axis permutations of it
+struct CubemapTable {
+	uint32_t			mFaceSize;
+	// normalized texel direction in face space ( u, v, 1 ) / length, and texel solid angle. Structure of arrays, mFaceSize * mFaceSize each
+	std::vector<float>	mU, mV, mW, mSolidAngle;
+};
+
+//! Returns the cached table for \a faceSize, computing it on first use. Tables are released once unused and out of the last four sizes requested
+std::shared_ptr<const CubemapTable> getCubemapTable( uint32_t faceSize );
+
+//! Axis permutation and signs mapping face space ( u, v, w ) to a world space direction for each face, following the opengl cubemap convention
+struct FaceBasis {
+	uint8_t	mAxis[3];	// face space component used for x, y and z
+	float	mSign[3];
+};
+const FaceBasis& getFaceBasis( uint8_t face );
+
+//! Specular power of the radiance lobe of \a mip, following cmft's gloss mapping and lighting model adjustment
+float getSpecularPower( uint8_t mip, uint8_t mipCount, uint8_t glossScale, uint8_t glossBias, LightingModel::Enum lightingModel );
+//! Angle in radians past which a cosine power lobe of \a specularPower falls under cmft's contribution threshold
+float getFilterAngle( float specularPower );
+
+//! Runs \a func for every index in [0, count) on \a numThreads threads including the calling one, 0 meaning all hardware threads. The helper threads are persistent and shared by every call
+void parallelFor( size_t count, const std::function<void( size_t )> &func, size_t numThreads = 0 );
+//! Same as parallelFor, \a func also receives the slot of the thread running it, in [0, getParallelForSlotCount( count, numThreads ) ), to index per thread scratch memory
+void parallelForSlots( size_t count, const std::function<void( size_t index, size_t slot )> &func, size_t numThreads = 0 );
+//! Returns the number of threads a parallelFor over \a count indices on \a numThreads threads runs on
+size_t getParallelForSlotCount( size_t count, size_t numThreads = 0 );
+
+//! Name of the simd instruction set the kernels have been compiled with
+const char* getSimdName();
+
+//! Source texel directions of the six faces grouped in square blocks that are culled as a whole by the radiance filter.
+//! Each block is stored as a structure of arrays padded to a multiple of the simd width, padding texels have a null direction and solid angle
+struct SourceBlocks {
+	uint32_t			mFaceSize, mBlockSize, mBlocksPerRow, mBlockStride;
+	std::vector<float>	mX, mY, mZ, mSolidAngle;
+	// bounding cone of each block texel directions
+	std::vector<float>	mCenters, mRadii;
+};
+
+//! Builds the block layout of a cubemap of size \a faceSize
+std::shared_ptr<const SourceBlocks> createSourceBlocks( uint32_t faceSize );
+
+//! Box filtered mip chain of the first mip of a RGBA32F cubemap. Each level stores the six faces one after the other
+struct SourcePyramid {
+	uint32_t							mFaceSize;
+	std::vector<std::vector<float>>	mLevels;
+};
+
+//! Builds the mip chain of \a input down to 1x1
+void buildSourcePyramid( SourcePyramid &pyramid, const Image &input, uint32_t numThreads );
+//! Trilinear lookup of the world space direction \a dir at the fractional \a level of \a pyramid
+void sampleSourcePyramid( const SourcePyramid &pyramid, const float *dir, float level, float *rgb );
+
+//! Level of the source pyramid an output \a mip of the native radiance filter is convolved against.
+//! The coarsest level that still resolves the lobe of \a specularPower, never smaller than the mip itself
+uint8_t getSourceLevel( uint32_t faceSize, uint8_t mip, float specularPower );
+
+//! Native radiance filter. Convolves each output mip with its cosine power lobe against the level \a sourceLevels[mip] of \a pyramid, laid out as \a levelBlocks[level].
+//! \a output is created as a RGBA32F cubemap with \a mipCount mips, processed in tiles on \a numThreads threads ( 0 for all hardware threads )
+void radianceFilter( Image &output, const SourcePyramid &pyramid, const std::vector<std::shared_ptr<const SourceBlocks>> &levelBlocks, const uint8_t *sourceLevels, const float *specularPowers, const float *filterAngles, uint8_t mipCount, bool excludeBase, bool warpFixup, uint32_t numThreads );
+
+//! Tangent space light direction of an importance sampled ggx lobe, with the normal along z, and the source level matching its pdf
+struct GgxSample {
+	float mX, mY, mZ, mLevel;
+};
+
+//! Precomputed ggx samples of every output mip. The samples only depend on the roughness since the view direction is assumed to be the normal
+struct GgxLobes {
+	uint32_t							mFaceSize;
+	std::vector<std::vector<GgxSample>>	mSamples;
+};
+
+//! Importance samples \a sampleCount directions of the lobe of each mip, roughness going linearly from 0 on the first mip to 1 on the last.
+//! The source levels assume a source of the size \a faceSize
+std::shared_ptr<const GgxLobes> createGgxLobes( uint32_t faceSize, uint8_t mipCount, uint32_t sampleCount );
+
+//! Ggx prefilter of the first mip of the RGBA32F cubemap \a input, of the size of \a lobes. The first mip is the unfiltered source.
+//! \a output is created as a RGBA32F cubemap with one mip per lobe, processed on \a numThreads threads ( 0 for all hardware threads )
+void ggxFilter( Image &output, const Image &input, const GgxLobes &lobes, uint32_t numThreads );
+
+//! Split sum environment brdf, NoV along x and roughness along y, with the scale and bias applied to F0 stored as 2 floats per texel.
+//! \a getBlinnPower maps a roughness to the power of a blinn-phong distribution, or is empty for the ggx distribution
+void integrateBrdf( float *output, uint32_t size, uint32_t sampleCount, const std::function<float( float )> &getBlinnPower, uint32_t numThreads );
+
+//! Projects the first mip of the RGBA32F cubemap \a input onto the first 9 spherical harmonics. Results are independent of the number of threads
+void projectSh( const Image &input, double shRgb[SH_COEFF_NUM][3] );
+//! Evaluates the spherical harmonics \a coeffs, 9 rgb triplets, into a RGB32F cubemap \a output of the size of \a table
+void evaluateSh( Image &output, const CubemapTable &table, const float *coeffs );
+
+} } // namespace cmft::detail
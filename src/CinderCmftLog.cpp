@@ -0,0 +1,236 @@
+#include "CinderCmftLog.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace cmft {
+
+namespace {
+	// bounded multiple producers single consumer queue of preformatted messages. The producers only
+	// claim a slot with a compare and swap and format the message in place, they never allocate and
+	// only take the mutex to wake up the logger thread when it sleeps on an empty queue
+	class Logger {
+	public:
+		static const size_t Capacity = 1024;
+		static const size_t MessageSize = 256;
+
+		Logger() : mLevel( LogLevel::Info ), mEnqueuePos( 0 ), mDequeuePos( 0 ), mDropped( 0 ), mStopped( false ), mSleeping( false ), mThreadRunning( false )
+		{
+			for( size_t i = 0; i < Capacity; ++i ) {
+				mSlots[i].mSequence.store( i, memory_order_relaxed );
+			}
+		}
+		~Logger()
+		{
+			if( mThreadRunning ) {
+				{
+					lock_guard<mutex> lock( mMutex );
+					mStopped = true;
+				}
+				mWakeUp.notify_one();
+				mThread.join();
+			}
+		}
+
+		bool isEnabled( LogLevel::Enum level ) const { return level >= mLevel.load( memory_order_relaxed ); }
+		void setLevel( LogLevel::Enum level ) { mLevel = level; }
+		LogLevel::Enum getLevel() const { return mLevel; }
+
+		void setSink( const LogSink &sink )
+		{
+			lock_guard<mutex> lock( mMutex );
+			mSink = sink;
+		}
+
+		void push( LogLevel::Enum level, const char *format, va_list args )
+		{
+			// the thread is started by the first message, the only allocation of the logger
+			call_once( mThreadStarted, [this]() {
+				mThread = thread( &Logger::run, this );
+				mThreadRunning = true;
+			} );
+
+			size_t pos = mEnqueuePos.load( memory_order_relaxed );
+			Slot *slot;
+			while( true ) {
+				slot = &mSlots[pos % Capacity];
+				size_t sequence = slot->mSequence.load( memory_order_acquire );
+				intptr_t difference = static_cast<intptr_t>( sequence ) - static_cast<intptr_t>( pos );
+				if( difference == 0 ) {
+					if( mEnqueuePos.compare_exchange_weak( pos, pos + 1, memory_order_relaxed ) ) {
+						break;
+					}
+				}
+				else if( difference < 0 ) {
+					++mDropped;
+					return;
+				}
+				else {
+					pos = mEnqueuePos.load( memory_order_relaxed );
+				}
+			}
+
+			// cmft messages come with their own line break, the sinks add theirs
+			slot->mLevel = level;
+			int length = vsnprintf( slot->mMessage, MessageSize, format, args );
+			length = length < 0 ? 0 : ( length < static_cast<int>( MessageSize ) ? length : static_cast<int>( MessageSize ) - 1 );
+			while( length > 0 && ( slot->mMessage[length - 1] == '\n' || slot->mMessage[length - 1] == '\r' ) ) {
+				slot->mMessage[--length] = '\0';
+			}
+			slot->mSequence.store( pos + 1, memory_order_release );
+
+			// pairs with the fence of the logger thread, either it sees the message or the message sees it sleeping. Taking
+			// the mutex makes sure it is waiting and not between its last check and the wait
+			atomic_thread_fence( memory_order_seq_cst );
+			if( mSleeping.load( memory_order_relaxed ) ) {
+				{
+					lock_guard<mutex> lock( mMutex );
+				}
+				mWakeUp.notify_one();
+			}
+		}
+
+		void flush()
+		{
+			if( ! mThreadRunning ) {
+				return;
+			}
+			size_t target = mEnqueuePos.load();
+			unique_lock<mutex> lock( mMutex );
+			mFlushed.wait( lock, [this, target]() { return mDequeuePos.load() >= target || mStopped; } );
+		}
+
+		uint64_t getDropped() const { return mDropped; }
+
+	protected:
+		struct Slot {
+			std::atomic<size_t>	mSequence;
+			LogLevel::Enum		mLevel;
+			char				mMessage[MessageSize];
+		};
+
+		bool hasMessage() const
+		{
+			size_t pos = mDequeuePos.load( memory_order_relaxed );
+			return mSlots[pos % Capacity].mSequence.load( memory_order_acquire ) == pos + 1;
+		}
+
+		void run()
+		{
+			unique_lock<mutex> lock( mMutex );
+			while( true ) {
+				// sleeps until a producer or the destructor wakes it up, no polling
+				mSleeping.store( true, memory_order_relaxed );
+				atomic_thread_fence( memory_order_seq_cst );
+				mWakeUp.wait( lock, [this]() { return mStopped || hasMessage(); } );
+				mSleeping.store( false, memory_order_relaxed );
+				LogSink sink = mSink;
+				bool stopped = mStopped;
+				lock.unlock();
+
+				while( true ) {
+					size_t pos = mDequeuePos.load( memory_order_relaxed );
+					Slot &slot = mSlots[pos % Capacity];
+					if( slot.mSequence.load( memory_order_acquire ) != pos + 1 ) {
+						break;
+					}
+					write( sink, slot.mLevel, slot.mMessage );
+					slot.mSequence.store( pos + Capacity, memory_order_release );
+					mDequeuePos.store( pos + 1, memory_order_release );
+				}
+
+				lock.lock();
+				mFlushed.notify_all();
+				if( stopped ) {
+					return;
+				}
+			}
+		}
+
+		static void write( const LogSink &sink, LogLevel::Enum level, const char *message )
+		{
+			if( sink ) {
+				sink( level, message );
+			}
+			else {
+				cerr << "cmft " << getLogLevelName( level ) << ": " << message << endl;
+			}
+		}
+
+		Slot						mSlots[Capacity];
+		std::atomic<LogLevel::Enum>	mLevel;
+		std::atomic<size_t>			mEnqueuePos, mDequeuePos;
+		std::atomic<uint64_t>		mDropped;
+
+		std::mutex					mMutex;
+		std::condition_variable		mWakeUp, mFlushed;
+		LogSink						mSink;
+		bool						mStopped;
+		std::atomic<bool>			mSleeping;
+		// set once the thread is started, read instead of std::thread::joinable() which races with its assignment
+		std::atomic<bool>			mThreadRunning;
+		std::once_flag				mThreadStarted;
+		std::thread					mThread;
+	};
+
+	Logger& getLogger()
+	{
+		static Logger logger;
+		return logger;
+	}
+}
+
+const char* getLogLevelName( LogLevel::Enum level )
+{
+	static const char* names[LogLevel::Count] = { "info", "warning", "error" };
+	return level < LogLevel::Count ? names[level] : "unknown";
+}
+
+void setLogLevel( LogLevel::Enum level )
+{
+	getLogger().setLevel( level );
+}
+
+LogLevel::Enum getLogLevel()
+{
+	return getLogger().getLevel();
+}
+
+void setLogSink( const LogSink &sink )
+{
+	getLogger().setSink( sink );
+}
+
+void logMessage( LogLevel::Enum level, const char *format, ... )
+{
+	va_list args;
+	va_start( args, format );
+	logMessageV( level, format, args );
+	va_end( args );
+}
+
+void logMessageV( LogLevel::Enum level, const char *format, va_list args )
+{
+	auto &logger = getLogger();
+	if( logger.isEnabled( level ) ) {
+		logger.push( level, format, args );
+	}
+}
+
+void flushLog()
+{
+	getLogger().flush();
+}
+
+uint64_t getDroppedLogCount()
+{
+	return getLogger().getDropped();
+}
+
+} // namespace cmft
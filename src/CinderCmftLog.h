@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstdint>
+#include <functional>
+
+namespace cmft {
+
+//! Severity of a logged message
+struct LogLevel {
+	enum Enum {
+		Info,
+		Warning,
+		Error,
+		Count
+	};
+};
+
+//! Returns the name of \a level
+const char* getLogLevelName( LogLevel::Enum level );
+
+//! Function the logged messages are written to, called from the logger thread only
+typedef std::function<void( LogLevel::Enum level, const char *message )> LogSink;
+
+//! Sets the minimum level of the logged messages, the others are dropped before being formatted. Defaults to LogLevel::Info
+void			setLogLevel( LogLevel::Enum level );
+//! Returns the minimum level of the logged messages
+LogLevel::Enum	getLogLevel();
+//! Sets the function the messages are written to. An empty sink, the default, writes to std::cerr
+void			setLogSink( const LogSink &sink );
+
+//! Queues a printf formatted message written by the logger thread. Never allocates and only locks briefly to wake up an idle logger thread, messages are truncated to 255 characters and dropped if the queue is full
+void			logMessage( LogLevel::Enum level, const char *format, ... );
+//! Queues a printf formatted message from a va_list
+void			logMessageV( LogLevel::Enum level, const char *format, va_list args );
+//! Blocks until every message queued so far has been written to the sink
+void			flushLog();
+//! Returns the number of messages dropped because the queue was full
+uint64_t		getDroppedLogCount();
+
+} // namespace cmft
@@ -0,0 +1,230 @@
+#include "CinderCmftTrace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace cmft {
+
+namespace detail {
+	std::atomic<bool> sTracingEnabled( false );
+}
+
+namespace {
+	// ring buffer slot. Every field is atomic so that the trace can be written while events are recorded, a torn slot is detected with its sequence number
+	struct TraceEvent {
+		std::atomic<uint64_t>		mSequence;	// index + 1 of the event stored, 0 while empty or being written
+		std::atomic<const char*>	mName;
+		std::atomic<int64_t>		mStart, mDuration;	// microseconds since the trace epoch
+		std::atomic<uint32_t>		mThread;
+	};
+
+	struct TraceEvents {
+		TraceEvents( size_t capacity ) : mEvents( new TraceEvent[capacity] ), mCapacity( capacity )
+		{
+			for( size_t i = 0; i < capacity; ++i ) {
+				mEvents[i].mSequence = 0;
+			}
+		}
+
+		std::unique_ptr<TraceEvent[]>	mEvents;
+		size_t							mCapacity;
+	};
+
+	struct TraceBuffer {
+		TraceBuffer() : mEvents( nullptr ), mWriters( 0 ), mNext( 0 ), mEpoch( chrono::steady_clock::now() ) {}
+		~TraceBuffer() { delete mEvents.load(); }
+
+		// only taken to resize, clear or write the trace and name threads, never by the events
+		std::mutex								mMutex;
+		// published atomically, the events being recorded are counted so that a replaced array is only freed once they are done with it
+		std::atomic<TraceEvents*>				mEvents;
+		std::atomic<uint32_t>					mWriters;
+		std::atomic<uint64_t>					mNext;
+		chrono::steady_clock::time_point		mEpoch;
+		std::vector<pair<uint32_t, const char*>> mThreadNames;
+	};
+
+	TraceBuffer& getTraceBuffer()
+	{
+		static TraceBuffer buffer;
+		return buffer;
+	}
+
+	const size_t sDefaultTraceCapacity = 1 << 16;
+
+	std::atomic<uint32_t>			sNextThreadId( 1 );
+	CMFT_THREAD_LOCAL uint32_t		sThreadId = 0;
+
+	// small sequential thread ids read better in the trace viewers than the native ones
+	uint32_t getTraceThreadId()
+	{
+		if( ! sThreadId ) {
+			sThreadId = sNextThreadId++;
+		}
+		return sThreadId;
+	}
+
+	// expects the buffer mutex to be locked. Safe while events are recorded, the previous array is freed once no event uses it anymore
+	void allocateEvents( TraceBuffer &buffer, size_t capacity )
+	{
+		TraceEvents *previous = buffer.mEvents.exchange( new TraceEvents( capacity ) );
+		buffer.mNext = 0;
+		while( buffer.mWriters.load() ) {
+			this_thread::yield();
+		}
+		delete previous;
+	}
+
+	void writeJsonString( std::ostream &stream, const char *text )
+	{
+		stream << '"';
+		for( const char *c = text; *c; ++c ) {
+			if( *c == '"' || *c == '\\' ) {
+				stream << '\\';
+			}
+			stream << *c;
+		}
+		stream << '"';
+	}
+}
+
+void setTracingEnabled( bool enabled )
+{
+	auto &buffer = getTraceBuffer();
+	if( enabled ) {
+		lock_guard<mutex> lock( buffer.mMutex );
+		if( ! buffer.mEvents.load() ) {
+			allocateEvents( buffer, sDefaultTraceCapacity );
+		}
+	}
+	detail::sTracingEnabled = enabled;
+}
+
+bool isTracingEnabled()
+{
+	return detail::sTracingEnabled;
+}
+
+void setTraceCapacity( size_t numEvents )
+{
+	auto &buffer = getTraceBuffer();
+	lock_guard<mutex> lock( buffer.mMutex );
+	allocateEvents( buffer, std::max<size_t>( numEvents, 1 ) );
+}
+
+void clearTrace()
+{
+	auto &buffer = getTraceBuffer();
+	lock_guard<mutex> lock( buffer.mMutex );
+	if( TraceEvents *events = buffer.mEvents.load() ) {
+		for( size_t i = 0; i < events->mCapacity; ++i ) {
+			events->mEvents[i].mSequence = 0;
+		}
+	}
+	buffer.mNext = 0;
+}
+
+void writeTrace( std::ostream &stream )
+{
+	struct Event {
+		const char	*mName;
+		int64_t		mStart, mDuration;
+		uint32_t	mThread;
+	};
+
+	// copy the events out of the ring buffer, skipping the slots being overwritten
+	std::vector<Event> events;
+	std::vector<pair<uint32_t, const char*>> threadNames;
+	{
+		auto &buffer = getTraceBuffer();
+		lock_guard<mutex> lock( buffer.mMutex );
+		const TraceEvents *traceEvents = buffer.mEvents.load();
+		const size_t capacity = traceEvents ? traceEvents->mCapacity : 0;
+		events.reserve( capacity );
+		for( size_t i = 0; i < capacity; ++i ) {
+			const auto &slot = traceEvents->mEvents[i];
+			uint64_t sequence = slot.mSequence.load( memory_order_acquire );
+			Event event = { slot.mName.load( memory_order_relaxed ), slot.mStart.load( memory_order_relaxed ), slot.mDuration.load( memory_order_relaxed ), slot.mThread.load( memory_order_relaxed ) };
+			atomic_thread_fence( memory_order_acquire );
+			if( sequence && slot.mSequence.load( memory_order_relaxed ) == sequence ) {
+				events.push_back( event );
+			}
+		}
+		threadNames = buffer.mThreadNames;
+	}
+	std::sort( events.begin(), events.end(), []( const Event &a, const Event &b ) { return a.mStart < b.mStart; } );
+
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	for( const auto &threadName : threadNames ) {
+		stream << ( first ? "\n" : ",\n" ) << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadName.first << ",\"args\":{\"name\":";
+		writeJsonString( stream, threadName.second );
+		stream << "}}";
+		first = false;
+	}
+	for( const auto &event : events ) {
+		stream << ( first ? "\n" : ",\n" ) << "{\"name\":";
+		writeJsonString( stream, event.mName );
+		stream << ",\"cat\":\"cmft\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.mThread << ",\"ts\":" << event.mStart << ",\"dur\":" << event.mDuration << "}";
+		first = false;
+	}
+	stream << "\n]}" << endl;
+}
+
+bool writeTrace( const std::string &filePath )
+{
+	std::ofstream file( filePath );
+	writeTrace( file );
+	return static_cast<bool>( file );
+}
+
+namespace detail {
+
+void recordTraceEvent( const char *name, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end )
+{
+	auto &buffer = getTraceBuffer();
+	buffer.mWriters.fetch_add( 1 );
+	TraceEvents *events = buffer.mEvents.load();
+	if( ! events ) {
+		buffer.mWriters.fetch_sub( 1, memory_order_release );
+		return;
+	}
+
+	uint64_t index = buffer.mNext.fetch_add( 1, memory_order_relaxed );
+	auto &slot = events->mEvents[index % events->mCapacity];
+	slot.mSequence.store( 0, memory_order_relaxed );
+	atomic_thread_fence( memory_order_release );
+	slot.mName.store( name, memory_order_relaxed );
+	slot.mStart.store( chrono::duration_cast<chrono::microseconds>( start - buffer.mEpoch ).count(), memory_order_relaxed );
+	slot.mDuration.store( chrono::duration_cast<chrono::microseconds>( end - start ).count(), memory_order_relaxed );
+	slot.mThread.store( getTraceThreadId(), memory_order_relaxed );
+	slot.mSequence.store( index + 1, memory_order_release );
+	buffer.mWriters.fetch_sub( 1, memory_order_release );
+}
+
+void setTraceThreadName( const char *name )
+{
+	if( ! sTracingEnabled.load( memory_order_relaxed ) ) {
+		return;
+	}
+
+	auto &buffer = getTraceBuffer();
+	uint32_t thread = getTraceThreadId();
+	lock_guard<mutex> lock( buffer.mMutex );
+	for( auto &threadName : buffer.mThreadNames ) {
+		if( threadName.first == thread ) {
+			threadName.second = name;
+			return;
+		}
+	}
+	buffer.mThreadNames.push_back( make_pair( thread, name ) );
+}
+
+} // namespace detail
+} // namespace cmft
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// trace events can be compiled out entirely by defining CMFT_TRACING to 0
+#if ! defined( CMFT_TRACING )
+	#define CMFT_TRACING 1
+#endif
+
+// vc2013 has no thread_local but supports thread local storage of plain types
+#if defined( _MSC_VER ) && _MSC_VER < 1900
+	#define CMFT_THREAD_LOCAL __declspec( thread )
+#else
+	#define CMFT_THREAD_LOCAL thread_local
+#endif
+
+namespace cmft {
+
+//! Enables or disables the recording of trace events. Disabled by default, a disabled scope only costs a relaxed atomic load
+void		setTracingEnabled( bool enabled );
+//! Returns whether trace events are being recorded
+bool		isTracingEnabled();
+//! Sets the number of events kept in the ring buffer, the oldest ones being overwritten. Clears the events, waits for the events being recorded to the previous buffer
+void		setTraceCapacity( size_t numEvents );
+//! Discards the recorded events
+void		clearTrace();
+//! Writes the recorded events as Chrome Trace Event json, to be opened in chrome://tracing or ui.perfetto.dev
+void		writeTrace( std::ostream &stream );
+//! Writes the recorded events as Chrome Trace Event json to the file at \a filePath
+bool		writeTrace( const std::string &filePath );
+
+namespace detail {
+
+extern std::atomic<bool> sTracingEnabled;
+
+//! Records a complete event of \a name, a string that has to outlive the trace, between \a start and \a end on the calling thread
+void recordTraceEvent( const char *name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end );
+//! Names the calling thread in the trace. \a name has to outlive the trace
+void setTraceThreadName( const char *name );
+
+#if CMFT_TRACING
+//! Records the lifetime of the scope as a trace event when tracing is enabled
+class TraceScope {
+public:
+	TraceScope( const char *name ) : mName( sTracingEnabled.load( std::memory_order_relaxed ) ? name : nullptr )
+	{
+		if( mName ) {
+			mStart = std::chrono::steady_clock::now();
+		}
+	}
+	~TraceScope()
+	{
+		if( mName ) {
+			recordTraceEvent( mName, mStart, std::chrono::steady_clock::now() );
+		}
+	}
+
+protected:
+	const char*								mName;
+	std::chrono::steady_clock::time_point	mStart;
+};
+#else
+class TraceScope {
+public:
+	TraceScope( const char * ) {}
+};
+#endif
+
+} // namespace detail
+} // namespace cmft
+
+#define CMFT_TRACE_CONCAT_IMPL( a, b ) a##b
+#define CMFT_TRACE_CONCAT( a, b ) CMFT_TRACE_CONCAT_IMPL( a, b )
+
+//! Records the enclosing scope as a trace event named \a name, a string literal
+#if CMFT_TRACING
+	#define CMFT_TRACE_SCOPE( name ) ::cmft::detail::TraceScope CMFT_TRACE_CONCAT( cmftTraceScope, __LINE__ )( name )
+#else
+	#define CMFT_TRACE_SCOPE( name ) do {} while( 0 )
+#endif
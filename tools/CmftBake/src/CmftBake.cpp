@@ -0,0 +1,392 @@
+// Offline bake of the Cinder-Cmft cache files. Headless, doesn't need a display nor a gpu.
+//
+// usage: CmftBake [options] <directory | manifest>
+//
+// Bakes the skybox, radiance and irradiance cache files of every .hdr, .exr, .dds, .ktx and .tga
+// image of a directory, or of every entry of a manifest, one "<path> [pmremSize] [iemSize]" per line.
+// The files are written exactly where and how the runtime looks for them. The cache keys include every
+// filter option, so a baked asset folder only avoids filtering at startup when the application loads it
+// with the options the files were baked with: the defaults, or the ones given with the options below.
+
+#include "CinderCmft.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ci;
+using namespace std;
+
+namespace {
+	//! Largest face size accepted on the command line and in manifests
+	const uint32_t sMaxFaceSize = 8192;
+
+	struct BakeEntry {
+		fs::path	mPath;
+		uint32_t	mPmremSize, mIemSize;
+	};
+
+	struct BakeSettings {
+		BakeSettings() : mPmremSize( 256 ), mIemSize( 64 ), mBrdfLutSize( 0 ), mSkybox( true ), mCacheSkybox( false ), mForce( false ), mPrune( false ), mNumJobs( 2 ), mNumThreads( 0 ) {}
+
+		uint32_t					mPmremSize, mIemSize, mBrdfLutSize;
+		bool						mSkybox, mCacheSkybox, mForce, mPrune;
+		uint32_t					mNumJobs, mNumThreads;
+		cmft::RadianceFilterOptions		mRadianceOptions;
+		cmft::IrradianceFilterOptions	mIrradianceOptions;
+		fs::path					mInput, mCacheDirectory;
+	};
+
+	void printUsage()
+	{
+		cout << "usage: CmftBake [options] <directory | manifest>" << endl
+			<< endl
+			<< "  --pmrem <size>        radiance face size up to 8192, 0 to disable (default 256)" << endl
+			<< "  --iem <size>          irradiance face size up to 8192, 0 to disable (default 64)" << endl
+			<< "  --no-skybox           don't convert the skybox cubemap" << endl
+			<< "  --cache-skybox        cache the converted skybox cubemap, at the source resolution" << endl
+			<< "  --ggx <samples>       prefilter the radiance with an importance sampled ggx lobe" << endl
+			<< "  --lighting <model>    phong, phong-brdf, blinn or blinn-brdf radiance lobe (default blinn-brdf)" << endl
+			<< "  --gloss-scale <n>     radiance gloss scale, up to 255 (default 10)" << endl
+			<< "  --gloss-bias <n>      radiance gloss bias, up to 255 (default 3)" << endl
+			<< "  --mips <n>            radiance mip count, 1 to 14 (default 7)" << endl
+			<< "  --exclude-base        leave the first radiance mip unfiltered" << endl
+			<< "  --edge-fixup          apply the warp edge fixup to the radiance" << endl
+			<< "  --pmrem-gamma <in> <out>  radiance input and output gamma (default 1 1)" << endl
+			<< "  --iem-gamma <in> <out>    irradiance input and output gamma (default 1 1)" << endl
+			<< "  --brdf-lut <size>     bake the brdf lookup table matching the radiance options" << endl
+			<< "  --backend <name>      auto, cpu, opencl-gpu, opencl-cpu or native (default auto, the runtime default)." << endl
+			<< "                        native files are keyed apart and only serve apps asking for ComputeBackend::NativeCpu" << endl
+			<< "  --jobs <n>            number of files baked in parallel, 1 to 256 (default 2)" << endl
+			<< "  --threads <n>         filter threads per file up to 255, 0 to share the hardware threads (default 0)" << endl
+			<< "  --cache-dir <dir>     cache directory, next to the sources when not set" << endl
+			<< "  --force               rebake entries that are already up to date" << endl
+			<< "  --prune               remove the cache files of the entries left by other versions, sizes and options" << endl
+			<< endl
+			<< "A manifest lists one \"<path> [pmremSize] [iemSize]\" entry per line, relative to the manifest." << endl
+			<< "The application has to load the files with the same filter options, any other option is keyed differently and filtered again." << endl;
+	}
+
+	// parses a decimal value between \a minValue and \a maxValue. stoul alone accepts a leading '-' and wraps it around
+	bool parseUnsigned( const string &text, uint32_t minValue, uint32_t maxValue, uint32_t *value )
+	{
+		if( text.empty() || ! isdigit( static_cast<unsigned char>( text[0] ) ) ) {
+			return false;
+		}
+		try {
+			size_t end;
+			unsigned long parsed = stoul( text, &end );
+			if( end != text.size() || parsed < minValue || parsed > maxValue ) {
+				return false;
+			}
+			*value = static_cast<uint32_t>( parsed );
+			return true;
+		}
+		catch( const std::exception & ) {
+			return false;
+		}
+	}
+
+	// parses a strictly positive and finite value, the gamma corrections
+	bool parsePositive( const string &text, float *value )
+	{
+		try {
+			size_t end;
+			float parsed = stof( text, &end );
+			if( end != text.size() || ! std::isfinite( parsed ) || parsed <= 0.0f ) {
+				return false;
+			}
+			*value = parsed;
+			return true;
+		}
+		catch( const std::exception & ) {
+			return false;
+		}
+	}
+
+	bool parseLightingModel( const string &name, cmft::LightingModel::Enum *model )
+	{
+		if( name == "phong" )				*model = cmft::LightingModel::Phong;
+		else if( name == "phong-brdf" )		*model = cmft::LightingModel::PhongBrdf;
+		else if( name == "blinn" )			*model = cmft::LightingModel::Blinn;
+		else if( name == "blinn-brdf" )		*model = cmft::LightingModel::BlinnBrdf;
+		else return false;
+		return true;
+	}
+
+	bool parseBackend( const string &name, cmft::ComputeBackend::Enum *backend )
+	{
+		if( name == "native" )			*backend = cmft::ComputeBackend::NativeCpu;
+		else if( name == "cpu" )		*backend = cmft::ComputeBackend::Cpu;
+		else if( name == "opencl-gpu" )	*backend = cmft::ComputeBackend::OpenClGpu;
+		else if( name == "opencl-cpu" )	*backend = cmft::ComputeBackend::OpenClCpu;
+		else if( name == "auto" )		*backend = cmft::ComputeBackend::Auto;
+		else return false;
+		return true;
+	}
+
+	bool parseArguments( int argc, char *argv[], BakeSettings *settings )
+	{
+		for( int i = 1; i < argc; ++i ) {
+			string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			bool valid = true;
+			uint32_t value = 0;
+			auto &radiance = settings->mRadianceOptions;
+			auto &irradiance = settings->mIrradianceOptions;
+			if( arg == "--pmrem" && hasValue )			valid = parseUnsigned( argv[++i], 0, sMaxFaceSize, &settings->mPmremSize );
+			else if( arg == "--iem" && hasValue )		valid = parseUnsigned( argv[++i], 0, sMaxFaceSize, &settings->mIemSize );
+			else if( arg == "--ggx" && hasValue ) {
+				valid = parseUnsigned( argv[++i], 1, 65536, &value );
+				radiance.filterMode( cmft::RadianceFilterMode::Ggx ).ggxSampleCount( value );
+			}
+			else if( arg == "--lighting" && hasValue )	valid = parseLightingModel( argv[++i], &radiance.mLightingModel );
+			else if( arg == "--gloss-scale" && hasValue ) {
+				valid = parseUnsigned( argv[++i], 0, 255, &value );
+				radiance.glossScale( static_cast<uint8_t>( value ) );
+			}
+			else if( arg == "--gloss-bias" && hasValue ) {
+				valid = parseUnsigned( argv[++i], 0, 255, &value );
+				radiance.glossBias( static_cast<uint8_t>( value ) );
+			}
+			else if( arg == "--mips" && hasValue ) {
+				valid = parseUnsigned( argv[++i], 1, 14, &value );
+				radiance.mipCount( static_cast<uint8_t>( value ) );
+			}
+			else if( arg == "--exclude-base" )			radiance.excludeBase( true );
+			else if( arg == "--edge-fixup" )			radiance.edgeFixup( cmft::EdgeFixup::Warp );
+			else if( arg == "--pmrem-gamma" && i + 2 < argc ) {
+				valid = parsePositive( argv[++i], &radiance.mGammaInput ) && parsePositive( argv[++i], &radiance.mGammaOutput );
+			}
+			else if( arg == "--iem-gamma" && i + 2 < argc ) {
+				valid = parsePositive( argv[++i], &irradiance.mGammaInput ) && parsePositive( argv[++i], &irradiance.mGammaOutput );
+			}
+			else if( arg == "--brdf-lut" && hasValue )	valid = parseUnsigned( argv[++i], 1, sMaxFaceSize, &settings->mBrdfLutSize );
+			else if( arg == "--jobs" && hasValue )		valid = parseUnsigned( argv[++i], 1, 256, &settings->mNumJobs );
+			else if( arg == "--threads" && hasValue )	valid = parseUnsigned( argv[++i], 0, 255, &settings->mNumThreads );
+			else if( arg == "--cache-dir" && hasValue )	settings->mCacheDirectory = argv[++i];
+			else if( arg == "--no-skybox" )				settings->mSkybox = false;
+			else if( arg == "--cache-skybox" )			settings->mCacheSkybox = true;
+			else if( arg == "--force" )					settings->mForce = true;
+			else if( arg == "--prune" )					settings->mPrune = true;
+			else if( arg == "--backend" && hasValue )	valid = parseBackend( argv[++i], &radiance.mBackend );
+			else if( arg.compare( 0, 2, "--" ) != 0 && settings->mInput.empty() ) {
+				settings->mInput = arg;
+			}
+			else {
+				cerr << "unexpected argument " << arg << endl;
+				return false;
+			}
+
+			if( ! valid ) {
+				cerr << "invalid value " << argv[i] << " for " << arg << endl;
+				return false;
+			}
+		}
+		return ! settings->mInput.empty();
+	}
+
+	bool isSourceImage( const fs::path &path )
+	{
+		auto extension = path.extension().string();
+		std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+		return extension == ".hdr" || extension == ".exr" || extension == ".dds" || extension == ".ktx" || extension == ".tga";
+	}
+
+	// returns whether \a path is a cache file, named <source stem><suffix>_<16 hex digits key>
+	bool isCacheFile( const fs::path &path )
+	{
+		auto stem = path.stem().string();
+		for( auto suffix : { "_em_", "_pmrem_", "_iem_" } ) {
+			auto pos = stem.rfind( suffix );
+			if( pos != string::npos && stem.size() - pos == strlen( suffix ) + 16 && std::all_of( stem.begin() + pos + strlen( suffix ), stem.end(), []( char c ) { return isxdigit( static_cast<unsigned char>( c ) ) != 0; } ) ) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// removes \a paths, the current cache files of an entry, without touching the files of other sources
+	void removeCacheFiles( const vector<fs::path> &paths )
+	{
+		for( const auto &path : paths ) {
+			try {
+				fs::remove( path );
+			}
+			catch( const std::exception & ) {
+			}
+		}
+	}
+
+	bool listEntries( const BakeSettings &settings, vector<BakeEntry> *entries )
+	{
+		if( fs::is_directory( settings.mInput ) ) {
+			for( fs::recursive_directory_iterator it( settings.mInput ), end; it != end; ++it ) {
+				if( fs::is_regular_file( it->path() ) && isSourceImage( it->path() ) && ! isCacheFile( it->path() ) ) {
+					entries->push_back( { it->path(), settings.mPmremSize, settings.mIemSize } );
+				}
+			}
+			std::sort( entries->begin(), entries->end(), []( const BakeEntry &a, const BakeEntry &b ) { return a.mPath < b.mPath; } );
+			return true;
+		}
+
+		std::ifstream manifest( settings.mInput.string() );
+		if( ! manifest ) {
+			cerr << "can't open " << settings.mInput << endl;
+			return false;
+		}
+		string line;
+		for( size_t lineNumber = 1; getline( manifest, line ); ++lineNumber ) {
+			if( line.empty() || line[0] == '#' ) {
+				continue;
+			}
+			istringstream stream( line );
+			string path;
+			BakeEntry entry = { fs::path(), settings.mPmremSize, settings.mIemSize };
+			if( ! ( stream >> path ) ) {
+				continue;
+			}
+			// extracting to an unsigned wraps negative sizes around, the sizes are validated as on the command line
+			string pmremSize, iemSize;
+			stream >> pmremSize >> iemSize;
+			if( ( ! pmremSize.empty() && ! parseUnsigned( pmremSize, 0, sMaxFaceSize, &entry.mPmremSize ) ) || ( ! iemSize.empty() && ! parseUnsigned( iemSize, 0, sMaxFaceSize, &entry.mIemSize ) ) ) {
+				cerr << settings.mInput.string() << ":" << lineNumber << ": invalid face size" << endl;
+				return false;
+			}
+			entry.mPath = fs::path( path ).is_absolute() ? fs::path( path ) : settings.mInput.parent_path() / path;
+			if( ! fs::exists( entry.mPath ) ) {
+				cerr << settings.mInput.string() << ":" << lineNumber << ": " << entry.mPath << " doesn't exist" << endl;
+				return false;
+			}
+			entries->push_back( entry );
+		}
+		return true;
+	}
+
+	cmft::EnvironmentOptions getEnvironmentOptions( const BakeSettings &settings, const BakeEntry &entry, uint8_t numThreads )
+	{
+		auto radianceOptions = settings.mRadianceOptions;
+		radianceOptions.numCpuProcessingThreads( numThreads );
+		return cmft::EnvironmentOptions()
+			.skybox( settings.mSkybox )
+			.cacheSkybox( settings.mCacheSkybox )
+			.pmrem( entry.mPmremSize, radianceOptions )
+			.iem( entry.mIemSize, settings.mIrradianceOptions );
+	}
+
+	// removes the cache files of \a entries that the current settings don't produce. Sources with the same stem in the same
+	// cache directory share their cache file names, each of them keeps the current files of all of them
+	size_t pruneEntries( const BakeSettings &settings, const vector<BakeEntry> &entries, uint8_t numThreads )
+	{
+		// cache directory and stem, to a source of the group and the files kept
+		map<fs::path, pair<fs::path, vector<fs::path>>> groups;
+		for( const auto &entry : entries ) {
+			auto directory = settings.mCacheDirectory.empty() ? entry.mPath.parent_path() : fs::path();
+			auto &group = groups[directory / entry.mPath.stem()];
+			auto paths = cmft::getEnvironmentSetCachePaths( entry.mPath, getEnvironmentOptions( settings, entry, numThreads ) );
+			group.first = entry.mPath;
+			group.second.insert( group.second.end(), paths.begin(), paths.end() );
+		}
+
+		size_t numRemoved = 0;
+		for( const auto &group : groups ) {
+			numRemoved += cmft::pruneCache( group.second.first, group.second.second );
+		}
+		return numRemoved;
+	}
+}
+
+int main( int argc, char *argv[] )
+{
+	BakeSettings settings;
+	if( ! parseArguments( argc, argv, &settings ) ) {
+		printUsage();
+		return 2;
+	}
+
+	vector<BakeEntry> entries;
+	if( ! listEntries( settings, &entries ) ) {
+		return 2;
+	}
+	if( ! settings.mCacheDirectory.empty() ) {
+		cmft::setCacheDirectory( settings.mCacheDirectory );
+	}
+
+	// the hardware threads are split between the files baked in parallel unless specified
+	uint32_t numJobs = std::min<uint32_t>( settings.mNumJobs, std::max<size_t>( entries.size(), 1 ) );
+	uint32_t numThreads = settings.mNumThreads ? settings.mNumThreads : std::max( 1u, thread::hardware_concurrency() / numJobs );
+	numThreads = std::min( numThreads, 255u );
+
+	atomic<size_t> nextEntry( 0 );
+	atomic<uint32_t> numBaked( 0 ), numSkipped( 0 ), numFailed( 0 );
+	mutex outputMutex;
+	auto bakeStart = chrono::steady_clock::now();
+
+	vector<thread> workers;
+	for( uint32_t i = 0; i < numJobs; ++i ) {
+		workers.emplace_back( [&]() {
+			for( size_t index = nextEntry++; index < entries.size(); index = nextEntry++ ) {
+				const auto &entry = entries[index];
+				auto options = getEnvironmentOptions( settings, entry, static_cast<uint8_t>( numThreads ) );
+
+				// the cache keys change with the source and options, existing files are up to date
+				if( ! settings.mForce && cmft::isEnvironmentSetCached( entry.mPath, options ) ) {
+					++numSkipped;
+					lock_guard<mutex> lock( outputMutex );
+					cout << "[" << index + 1 << "/" << entries.size() << "] " << entry.mPath.string() << " up to date" << endl;
+					continue;
+				}
+
+				if( settings.mForce ) {
+					removeCacheFiles( cmft::getEnvironmentSetCachePaths( entry.mPath, options ) );
+				}
+
+				auto start = chrono::steady_clock::now();
+				cmft::Image em, pmrem, iem;
+				bool succeeded = cmft::createEnvironmentSet( entry.mPath, em, pmrem, iem, options );
+				for( auto image : { &em, &pmrem, &iem } ) {
+					if( cmft::imageIsValid( *image ) ) {
+						cmft::imageUnload( *image );
+					}
+				}
+				auto seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+				++( succeeded ? numBaked : numFailed );
+				lock_guard<mutex> lock( outputMutex );
+				cout << "[" << index + 1 << "/" << entries.size() << "] " << entry.mPath.string() << ( succeeded ? " baked in " : " FAILED after " ) << seconds << "s" << endl;
+			}
+		} );
+	}
+	for( auto &worker : workers ) {
+		worker.join();
+	}
+
+	bool succeeded = numFailed == 0;
+	if( settings.mPrune ) {
+		cout << pruneEntries( settings, entries, static_cast<uint8_t>( numThreads ) ) << " stale cache files removed" << endl;
+	}
+	if( settings.mBrdfLutSize ) {
+		auto options = getEnvironmentOptions( settings, { fs::path(), settings.mPmremSize, settings.mIemSize }, static_cast<uint8_t>( numThreads ) ).mPmremOptions;
+		vector<uint32_t> lut;
+		bool baked = cmft::createBrdfLut( lut, settings.mBrdfLutSize, options, true );
+		cout << "brdf lut " << settings.mBrdfLutSize << "x" << settings.mBrdfLutSize << ( baked ? " baked" : " FAILED" ) << endl;
+		succeeded &= baked;
+	}
+
+	auto seconds = chrono::duration<double>( chrono::steady_clock::now() - bakeStart ).count();
+	cout << numBaked << " baked, " << numSkipped << " up to date, " << numFailed << " failed in " << seconds << "s" << endl;
+
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,561 @@
+// Benchmarks of the Cinder-Cmft bake pipeline. Headless, runs on synthetic inputs so it doesn't need any asset.
+//
+// usage: CmftBenchmark [--quick] [--iterations <n>] [--filter <substring>] [--output <file.json>]
+//                      [--baseline <file.json>] [--threshold <percent>] [--noise <stddevs>]
+//
+// Covers loading, layout conversion, resizing, the radiance and irradiance filters for several sizes,
+// thread counts and backends, and the cache files. Results are written as json, to stdout unless
+// an output file is given, and summarized on stderr. Texture uploads need an opengl context and aren't
+// covered, the Demo sample performance panel shows their cost.
+//
+// With --baseline the results are compared to a previous run: a benchmark regresses when its median time
+// grows by more than the threshold percentage and by more than the noise multiple of the standard deviations,
+// or when its peak image memory grows by more than the threshold percentage. Exits with 3 on regressions.
+
+#include "CinderCmft.h"
+#include "CinderCmftKernels.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ci;
+using namespace std;
+
+namespace {
+	struct BenchmarkSettings {
+		BenchmarkSettings() : mQuick( false ), mIterations( 5 ), mThreshold( 10.0 ), mNoise( 3.0 ) {}
+
+		bool		mQuick;
+		uint32_t	mIterations;
+		string		mFilter;
+		fs::path	mOutput, mBaseline;
+		double		mThreshold;		// percentage of the baseline a benchmark can grow by
+		double		mNoise;			// number of standard deviations a time difference has to exceed
+	};
+
+	struct BenchmarkResult {
+		BenchmarkResult() : mPeakBytes( 0 ) {}
+
+		string			mName;
+		vector<double>	mMilliseconds;
+		uint64_t		mPeakBytes;		// peak of the image memory tracked by the block over the iterations
+	};
+
+	//! Summary of a benchmark, as written to and read back from the json
+	struct BenchmarkSummary {
+		BenchmarkSummary() : mIterations( 0 ), mMin( 0.0 ), mMedian( 0.0 ), mMean( 0.0 ), mMax( 0.0 ), mStddev( 0.0 ), mPeakBytes( 0 ) {}
+
+		string		mName;
+		size_t		mIterations;
+		double		mMin, mMedian, mMean, mMax, mStddev;
+		uint64_t	mPeakBytes;
+	};
+
+	BenchmarkSummary summarize( const BenchmarkResult &result )
+	{
+		BenchmarkSummary summary;
+		auto sorted = result.mMilliseconds;
+		std::sort( sorted.begin(), sorted.end() );
+		double mean = 0.0;
+		for( auto ms : sorted ) {
+			mean += ms;
+		}
+		mean /= sorted.size();
+		double variance = 0.0;
+		for( auto ms : sorted ) {
+			variance += ( ms - mean ) * ( ms - mean );
+		}
+
+		summary.mName = result.mName;
+		summary.mIterations = sorted.size();
+		summary.mMin = sorted.front();
+		summary.mMedian = sorted[sorted.size() / 2];
+		summary.mMean = mean;
+		summary.mMax = sorted.back();
+		summary.mStddev = sorted.size() > 1 ? sqrt( variance / ( sorted.size() - 1 ) ) : 0.0;
+		summary.mPeakBytes = result.mPeakBytes;
+		return summary;
+	}
+
+	class BenchmarkRunner {
+	public:
+		BenchmarkRunner( const BenchmarkSettings &settings ) : mSettings( settings ) {}
+
+		//! Times \a measured \a iterations times, \a setup and \a teardown run before and after each iteration outside of the measure
+		void run( const string &name, const function<void()> &setup, const function<void()> &measured, const function<void()> &teardown, uint32_t iterations = 0 )
+		{
+			if( ! mSettings.mFilter.empty() && name.find( mSettings.mFilter ) == string::npos ) {
+				return;
+			}
+
+			BenchmarkResult result;
+			result.mName = name;
+			iterations = iterations ? iterations : mSettings.mIterations;
+			for( uint32_t i = 0; i < iterations; ++i ) {
+				setup();
+				// the peak restarts from the live images, only the measured part counts
+				cmft::resetMetrics();
+				uint64_t liveBytes = cmft::getMetrics().mLiveImageBytes;
+				auto start = chrono::steady_clock::now();
+				measured();
+				result.mMilliseconds.push_back( chrono::duration<double, milli>( chrono::steady_clock::now() - start ).count() );
+				result.mPeakBytes = std::max( result.mPeakBytes, cmft::getMetrics().mPeakImageBytes - liveBytes );
+				teardown();
+			}
+
+			auto sorted = result.mMilliseconds;
+			std::sort( sorted.begin(), sorted.end() );
+			cerr << std::left << setw( 40 ) << name << std::right << fixed << setprecision( 3 ) << setw( 12 ) << sorted[sorted.size() / 2] << " ms" << endl;
+			mResults.push_back( result );
+		}
+
+		void writeJson( std::ostream &stream ) const
+		{
+			stream << "{" << endl;
+			stream << "\t\"version\": 2," << endl;
+			stream << "\t\"timestamp\": " << std::time( nullptr ) << "," << endl;
+			stream << "\t\"simd\": \"" << cmft::detail::getSimdName() << "\"," << endl;
+			stream << "\t\"hardware_threads\": " << thread::hardware_concurrency() << "," << endl;
+			stream << "\t\"quick\": " << ( mSettings.mQuick ? "true" : "false" ) << "," << endl;
+			stream << "\t\"benchmarks\": [" << endl;
+			for( size_t i = 0; i < mResults.size(); ++i ) {
+				auto summary = summarize( mResults[i] );
+				stream << "\t\t{ \"name\": \"" << summary.mName << "\", \"iterations\": " << summary.mIterations
+					<< setprecision( 6 ) << fixed
+					<< ", \"min_ms\": " << summary.mMin
+					<< ", \"median_ms\": " << summary.mMedian
+					<< ", \"mean_ms\": " << summary.mMean
+					<< ", \"max_ms\": " << summary.mMax
+					<< ", \"stddev_ms\": " << summary.mStddev
+					<< ", \"peak_bytes\": " << summary.mPeakBytes << " }" << ( i + 1 < mResults.size() ? "," : "" ) << endl;
+			}
+			stream << "\t]" << endl;
+			stream << "}" << endl;
+		}
+
+		const vector<BenchmarkResult>& getResults() const { return mResults; }
+
+	protected:
+		BenchmarkSettings		mSettings;
+		vector<BenchmarkResult>	mResults;
+	};
+
+	//! Synthetic lat-long environment, a sky gradient with a small and very bright sun so the filters see a realistic dynamic range
+	void createSyntheticLatLong( cmft::Image &output, uint32_t height )
+	{
+		uint32_t width = height * 2;
+		cmft::imageCreate( output, width, height, 0, 1, 1, cmft::TextureFormat::RGBA32F );
+
+		const float pi = 3.14159265f;
+		const float sunDir[3] = { 0.48f, 0.6f, 0.64f };
+		float *texels = static_cast<float*>( output.m_data );
+		for( uint32_t y = 0; y < height; ++y ) {
+			float theta = ( y + 0.5f ) / height * pi;
+			for( uint32_t x = 0; x < width; ++x ) {
+				float phi = ( x + 0.5f ) / width * 2.0f * pi;
+				float dir[3] = { sinf( theta ) * cosf( phi ), cosf( theta ), sinf( theta ) * sinf( phi ) };
+				float sun = std::max( 0.0f, dir[0] * sunDir[0] + dir[1] * sunDir[1] + dir[2] * sunDir[2] );
+				sun = sun > 0.999f ? 500.0f : 2.0f * powf( sun, 32.0f );
+				float sky = 0.5f + 0.5f * dir[1];
+
+				float *texel = texels + ( y * width + x ) * 4;
+				texel[0] = 0.2f * sky + sun;
+				texel[1] = 0.4f * sky + sun;
+				texel[2] = 0.8f * sky + 0.9f * sun;
+				texel[3] = 1.0f;
+			}
+		}
+	}
+
+	void unload( cmft::Image &image )
+	{
+		if( cmft::imageIsValid( image ) ) {
+			cmft::imageUnload( image );
+		}
+	}
+
+	const char* getBackendName( cmft::ComputeBackend::Enum backend )
+	{
+		switch( backend ) {
+			case cmft::ComputeBackend::Auto:		return "auto";
+			case cmft::ComputeBackend::Cpu:			return "cpu";
+			case cmft::ComputeBackend::OpenClGpu:	return "opencl-gpu";
+			case cmft::ComputeBackend::OpenClCpu:	return "opencl-cpu";
+			case cmft::ComputeBackend::NativeCpu:	return "native";
+			default:								break;
+		}
+		return "unknown";
+	}
+
+	//! Returns the number following \a key in \a json, a flat object
+	bool readJsonNumber( const string &json, const string &key, double *value )
+	{
+		auto pos = json.find( "\"" + key + "\"" );
+		pos = pos != string::npos ? json.find( ':', pos ) : pos;
+		if( pos == string::npos ) {
+			return false;
+		}
+		const char *begin = json.c_str() + pos + 1;
+		char *end = nullptr;
+		*value = strtod( begin, &end );
+		return end != begin;
+	}
+
+	//! Returns the string following \a key in \a json, a flat object. Escaped quotes aren't supported
+	bool readJsonString( const string &json, const string &key, string *value )
+	{
+		auto pos = json.find( "\"" + key + "\"" );
+		pos = pos != string::npos ? json.find( ':', pos ) : pos;
+		auto begin = pos != string::npos ? json.find( '"', pos ) : pos;
+		auto end = begin != string::npos ? json.find( '"', begin + 1 ) : begin;
+		if( end == string::npos ) {
+			return false;
+		}
+		*value = json.substr( begin + 1, end - begin - 1 );
+		return true;
+	}
+
+	struct Baseline {
+		string						mSimd;
+		double						mHardwareThreads;
+		bool						mQuick;
+		vector<BenchmarkSummary>	mBenchmarks;
+	};
+
+	//! Reads a json written by this tool. Baselines of the first version have no peak memory, it is read as 0 and not compared
+	bool loadBaseline( const fs::path &path, Baseline *baseline )
+	{
+		std::ifstream file( path.string() );
+		if( ! file ) {
+			return false;
+		}
+		stringstream stream;
+		stream << file.rdbuf();
+		const string json = stream.str();
+
+		auto benchmarks = json.find( "\"benchmarks\"" );
+		if( benchmarks == string::npos ) {
+			return false;
+		}
+		const string header = json.substr( 0, benchmarks );
+		baseline->mHardwareThreads = 0.0;
+		readJsonString( header, "simd", &baseline->mSimd );
+		readJsonNumber( header, "hardware_threads", &baseline->mHardwareThreads );
+		baseline->mQuick = header.find( "\"quick\": true" ) != string::npos;
+
+		// every benchmark is a flat object
+		for( auto begin = json.find( '{', benchmarks ); begin != string::npos; begin = json.find( '{', begin + 1 ) ) {
+			auto end = json.find( '}', begin );
+			if( end == string::npos ) {
+				return false;
+			}
+			const string object = json.substr( begin, end - begin + 1 );
+			BenchmarkSummary summary;
+			double iterations = 0.0, peakBytes = 0.0;
+			if( ! readJsonString( object, "name", &summary.mName ) || ! readJsonNumber( object, "median_ms", &summary.mMedian ) ) {
+				return false;
+			}
+			readJsonNumber( object, "iterations", &iterations );
+			readJsonNumber( object, "min_ms", &summary.mMin );
+			readJsonNumber( object, "mean_ms", &summary.mMean );
+			readJsonNumber( object, "max_ms", &summary.mMax );
+			readJsonNumber( object, "stddev_ms", &summary.mStddev );
+			readJsonNumber( object, "peak_bytes", &peakBytes );
+			summary.mIterations = static_cast<size_t>( iterations );
+			summary.mPeakBytes = static_cast<uint64_t>( peakBytes );
+			baseline->mBenchmarks.push_back( summary );
+		}
+		return true;
+	}
+
+	//! Prints the differences between \a results and \a baseline on stderr, returns the number of regressions
+	size_t compareToBaseline( const vector<BenchmarkResult> &results, const Baseline &baseline, const BenchmarkSettings &settings )
+	{
+		if( baseline.mSimd != cmft::detail::getSimdName() || static_cast<unsigned>( baseline.mHardwareThreads ) != thread::hardware_concurrency() || baseline.mQuick != settings.mQuick ) {
+			cerr << "warning: the baseline was recorded with " << baseline.mSimd << ", " << baseline.mHardwareThreads << " hardware threads" << ( baseline.mQuick ? ", --quick" : "" ) << ", timings may not be comparable" << endl;
+		}
+
+		cerr << endl << std::left << setw( 40 ) << "benchmark" << std::right << setw( 12 ) << "baseline" << setw( 12 ) << "current" << setw( 10 ) << "time" << setw( 10 ) << "memory" << "  status" << endl;
+		size_t regressions = 0;
+		for( const auto &result : results ) {
+			auto current = summarize( result );
+			auto it = find_if( baseline.mBenchmarks.begin(), baseline.mBenchmarks.end(), [&current]( const BenchmarkSummary &summary ) { return summary.mName == current.mName; } );
+			if( it == baseline.mBenchmarks.end() ) {
+				cerr << std::left << setw( 40 ) << current.mName << std::right << setw( 12 ) << "-" << setw( 12 ) << current.mMedian << setw( 10 ) << "-" << setw( 10 ) << "-" << "  new" << endl;
+				continue;
+			}
+
+			// a time difference within the noise of either run doesn't count, whatever its percentage
+			const double delta = current.mMedian - it->mMedian;
+			const double noise = settings.mNoise * std::max( current.mStddev, it->mStddev );
+			const double timePercent = it->mMedian > 0.0 ? 100.0 * delta / it->mMedian : 0.0;
+			const bool slower = timePercent > settings.mThreshold && delta > noise;
+			const bool faster = timePercent < -settings.mThreshold && -delta > noise;
+
+			// the image memory is deterministic, only the threshold applies
+			const bool hasMemory = it->mPeakBytes > 0;
+			const double memoryPercent = hasMemory ? 100.0 * ( static_cast<double>( current.mPeakBytes ) - it->mPeakBytes ) / it->mPeakBytes : 0.0;
+			const bool larger = hasMemory && memoryPercent > settings.mThreshold;
+
+			stringstream timeColumn, memoryColumn;
+			timeColumn << showpos << fixed << setprecision( 1 ) << timePercent << "%";
+			memoryColumn << showpos << fixed << setprecision( 1 ) << memoryPercent << "%";
+			string status = slower && larger ? "REGRESSED time memory" : slower ? "REGRESSED time" : larger ? "REGRESSED memory" : faster ? "faster" : "ok";
+			cerr << std::left << setw( 40 ) << current.mName << std::right << fixed << setprecision( 3 ) << setw( 12 ) << it->mMedian << setw( 12 ) << current.mMedian
+				<< setw( 10 ) << timeColumn.str() << setw( 10 ) << ( hasMemory ? memoryColumn.str() : "-" ) << "  " << status << endl;
+			regressions += ( slower || larger ) ? 1 : 0;
+		}
+
+		// benchmarks that disappeared, unless filtered out of this run
+		for( const auto &summary : baseline.mBenchmarks ) {
+			bool ran = find_if( results.begin(), results.end(), [&summary]( const BenchmarkResult &result ) { return result.mName == summary.mName; } ) != results.end();
+			if( ! ran && ( settings.mFilter.empty() || summary.mName.find( settings.mFilter ) != string::npos ) ) {
+				cerr << std::left << setw( 40 ) << summary.mName << std::right << fixed << setprecision( 3 ) << setw( 12 ) << summary.mMedian << setw( 12 ) << "-" << setw( 10 ) << "-" << setw( 10 ) << "-" << "  missing" << endl;
+			}
+		}
+
+		cerr << endl << regressions << " regression" << ( regressions == 1 ? "" : "s" ) << " over a " << setprecision( 1 ) << settings.mThreshold << "% threshold and " << settings.mNoise << " standard deviations" << endl;
+		return regressions;
+	}
+
+	void printUsage()
+	{
+		cerr << "usage: CmftBenchmark [--quick] [--iterations <n>] [--filter <substring>] [--output <file.json>]" << endl;
+		cerr << "                     [--baseline <file.json>] [--threshold <percent>] [--noise <stddevs>]" << endl;
+		cerr << "iterations from 1 to 10000, threshold from 0 to 1000 percent, noise from 0 to 100 standard deviations" << endl;
+	}
+
+	// parses a decimal value between \a minValue and \a maxValue. stoul alone accepts a leading '-' and wraps it around
+	bool parseUnsigned( const string &text, uint32_t minValue, uint32_t maxValue, uint32_t *value )
+	{
+		if( text.empty() || ! isdigit( static_cast<unsigned char>( text[0] ) ) ) {
+			return false;
+		}
+		try {
+			size_t end;
+			unsigned long parsed = stoul( text, &end );
+			if( end != text.size() || parsed < minValue || parsed > maxValue ) {
+				return false;
+			}
+			*value = static_cast<uint32_t>( parsed );
+			return true;
+		}
+		catch( const std::exception & ) {
+			return false;
+		}
+	}
+
+	// parses a finite value between 0 and \a maxValue
+	bool parseNonNegative( const string &text, double maxValue, double *value )
+	{
+		try {
+			size_t end;
+			double parsed = stod( text, &end );
+			if( end != text.size() || ! std::isfinite( parsed ) || parsed < 0.0 || parsed > maxValue ) {
+				return false;
+			}
+			*value = parsed;
+			return true;
+		}
+		catch( const std::exception & ) {
+			return false;
+		}
+	}
+
+	bool parseArguments( int argc, char *argv[], BenchmarkSettings *settings )
+	{
+		for( int i = 1; i < argc; ++i ) {
+			string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			bool valid = true;
+			if( arg == "--quick" )							settings->mQuick = true;
+			else if( arg == "--iterations" && hasValue )	valid = parseUnsigned( argv[++i], 1, 10000, &settings->mIterations );
+			else if( arg == "--filter" && hasValue )		settings->mFilter = argv[++i];
+			else if( arg == "--output" && hasValue )		settings->mOutput = argv[++i];
+			else if( arg == "--baseline" && hasValue )		settings->mBaseline = argv[++i];
+			else if( arg == "--threshold" && hasValue )		valid = parseNonNegative( argv[++i], 1000.0, &settings->mThreshold );
+			else if( arg == "--noise" && hasValue )			valid = parseNonNegative( argv[++i], 100.0, &settings->mNoise );
+			else {
+				printUsage();
+				return false;
+			}
+
+			if( ! valid ) {
+				cerr << "invalid value " << argv[i] << " for " << arg << endl;
+				printUsage();
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main( int argc, char *argv[] )
+{
+	BenchmarkSettings settings;
+	if( ! parseArguments( argc, argv, &settings ) ) {
+		return 2;
+	}
+
+	// read the baseline first, no point in running the benchmarks if it's unusable
+	Baseline baseline;
+	if( ! settings.mBaseline.empty() && ! loadBaseline( settings.mBaseline, &baseline ) ) {
+		cerr << "can't read the baseline " << settings.mBaseline << endl;
+		return 2;
+	}
+
+	// synthetic inputs, written to a scratch directory for the file benchmarks
+	auto scratch = fs::temp_directory_path() / ( "CmftBenchmark_" + to_string( std::time( nullptr ) ) );
+	fs::create_directories( scratch );
+	cmft::setCacheDirectory( scratch / "cache" );
+
+	uint32_t sourceHeight = settings.mQuick ? 256 : 1024;
+	cmft::Image latLong, cubemap;
+	createSyntheticLatLong( latLong, sourceHeight );
+	cmft::imageCopy( cubemap, latLong );
+	cmft::imageCubemapFromLatLong( cubemap );
+
+	// cmft saves cubemaps only, converting them to the requested layout
+	auto sourceStem = ( scratch / "source" ).string();
+	cmft::imageSave( cubemap, sourceStem.c_str(), cmft::ImageFileType::HDR, cmft::OutputType::LatLong, cmft::TextureFormat::RGBE );
+	cmft::imageSave( cubemap, sourceStem.c_str(), cmft::ImageFileType::DDS, cmft::OutputType::LatLong, cmft::TextureFormat::RGBA16F );
+	cmft::imageSave( cubemap, sourceStem.c_str(), cmft::ImageFileType::KTX, cmft::OutputType::LatLong, cmft::TextureFormat::RGBA16F );
+
+	BenchmarkRunner runner( settings );
+	cmft::Image input, output;
+	auto noop = [](){};
+	auto unloadAll = [&]() { unload( input ); unload( output ); };
+
+	// loading
+	for( auto extension : { "hdr", "dds", "ktx" } ) {
+		auto path = sourceStem + "." + extension;
+		runner.run( string( "load/imageLoad/" ) + extension, noop, [&]() { cmft::imageLoad( input, path.c_str(), cmft::TextureFormat::RGBA32F ); }, unloadAll );
+	}
+	{
+		auto path = sourceStem + ".hdr";
+		runner.run( "load/imageLoadStb/hdr", noop, [&]() { cmft::imageLoadStb( input, path.c_str(), cmft::TextureFormat::RGBA32F ); }, unloadAll );
+	}
+
+	// layout conversions, from each layout cmft can produce back to a cubemap
+	vector<pair<string, function<void( cmft::Image& )>>> layouts = {
+		{ "latlong", [&]( cmft::Image &dst ) { cmft::imageCopy( dst, latLong ); } },
+		{ "hcross", [&]( cmft::Image &dst ) { cmft::imageCrossFromCubemap( dst, cubemap, false ); } },
+		{ "vcross", [&]( cmft::Image &dst ) { cmft::imageCrossFromCubemap( dst, cubemap, true ); } },
+		{ "hstrip", [&]( cmft::Image &dst ) { cmft::imageStripFromCubemap( dst, cubemap, false ); } },
+		{ "vstrip", [&]( cmft::Image &dst ) { cmft::imageStripFromCubemap( dst, cubemap, true ); } },
+		{ "octant", [&]( cmft::Image &dst ) { cmft::imageOctantFromCubemap( dst, cubemap ); } }
+	};
+	for( auto &layout : layouts ) {
+		cmft::Image source;
+		layout.second( source );
+		runner.run( "convertToCubemap/" + layout.first, [&]() { cmft::imageCopy( input, source ); }, [&]() { cmft::convertToCubemap( input ); }, unloadAll );
+		unload( source );
+	}
+
+	// resizing
+	for( uint32_t faceSize : { 256u, 128u } ) {
+		runner.run( "imageResize/" + to_string( cubemap.m_width ) + "/" + to_string( faceSize ), [&]() { cmft::imageCopy( input, cubemap ); }, [&]() { cmft::imageResize( input, faceSize ); }, unloadAll );
+	}
+
+	// radiance filter, including the resize and gamma createPmrem applies to its input
+	uint32_t hardwareThreads = std::max( 1u, std::min( 255u, thread::hardware_concurrency() ) );
+	vector<uint32_t> pmremSizes = settings.mQuick ? vector<uint32_t>{ 32, 64 } : vector<uint32_t>{ 64, 128, 256 };
+	vector<uint32_t> threadCounts = hardwareThreads > 1 ? vector<uint32_t>{ 1, hardwareThreads } : vector<uint32_t>{ 1 };
+	struct FilterVariant {
+		cmft::ComputeBackend::Enum	mBackend;
+		cmft::RadianceFilterMode::Enum	mMode;
+	};
+	vector<FilterVariant> variants = {
+		{ cmft::ComputeBackend::Cpu, cmft::RadianceFilterMode::CosinePower },
+		{ cmft::ComputeBackend::NativeCpu, cmft::RadianceFilterMode::CosinePower },
+		{ cmft::ComputeBackend::NativeCpu, cmft::RadianceFilterMode::Ggx },
+		{ cmft::ComputeBackend::OpenClGpu, cmft::RadianceFilterMode::CosinePower }
+	};
+
+	// without an OpenCL gpu device the filter falls back to cpu threads, the variant would time cmft's cpu filter under the opencl name
+	{
+		cmft::imageCopy( input, cubemap );
+		cmft::createPmrem( input, output, 16, cmft::RadianceFilterOptions().backend( cmft::ComputeBackend::OpenClGpu ).mipCount( 1 ) );
+		unloadAll();
+		auto backend = cmft::getLastBakeStats().mBackend;
+		if( backend != cmft::ComputeBackend::OpenClGpu ) {
+			cerr << "opencl-gpu falls back to " << getBackendName( backend ) << ", skipping its benchmarks" << endl;
+			variants.erase( remove_if( variants.begin(), variants.end(), []( const FilterVariant &variant ) { return variant.mBackend == cmft::ComputeBackend::OpenClGpu; } ), variants.end() );
+		}
+	}
+	for( auto faceSize : pmremSizes ) {
+		for( auto &variant : variants ) {
+			for( auto numThreads : threadCounts ) {
+				// the OpenCL kernels don't use the cpu threads
+				if( variant.mBackend == cmft::ComputeBackend::OpenClGpu && numThreads != threadCounts.back() ) {
+					continue;
+				}
+				auto options = cmft::RadianceFilterOptions().backend( variant.mBackend ).filterMode( variant.mMode ).numCpuProcessingThreads( static_cast<uint8_t>( numThreads ) );
+				auto name = "createPmrem/" + string( getBackendName( variant.mBackend ) ) + ( variant.mMode == cmft::RadianceFilterMode::Ggx ? "-ggx/" : "/" ) + to_string( faceSize ) + "/t" + to_string( numThreads );
+				// the cmft cpu backend is too slow for repeated runs at large sizes
+				uint32_t iterations = variant.mBackend == cmft::ComputeBackend::Cpu && faceSize > 64 ? 1 : 0;
+				runner.run( name, [&]() { cmft::imageCopy( input, cubemap ); }, [&]() { cmft::createPmrem( input, output, faceSize, options ); }, unloadAll, iterations );
+			}
+		}
+	}
+
+	// irradiance filter
+	for( uint32_t faceSize : { 32u, 64u } ) {
+		runner.run( "createIem/" + to_string( faceSize ), [&]() { cmft::imageCopy( input, cubemap ); }, [&]() { cmft::createIem( input, output, faceSize ); }, unloadAll );
+	}
+
+	// cache files, written and read the way the runtime does
+	{
+		uint32_t faceSize = pmremSizes.back();
+		auto options = cmft::RadianceFilterOptions().backend( cmft::ComputeBackend::NativeCpu );
+		cmft::Image pmrem;
+		cmft::imageCopy( input, cubemap );
+		cmft::createPmrem( input, pmrem, faceSize, options );
+		unload( input );
+
+		auto cacheStem = ( scratch / "cache_save" ).string();
+		runner.run( "cache/save/pmrem/" + to_string( faceSize ), noop, [&]() {
+			cmft::imageSave( pmrem, cacheStem.c_str(), cmft::ImageFileType::DDS, cmft::OutputType::Cubemap, cmft::TextureFormat::RGBA16F );
+		}, noop );
+		unload( pmrem );
+
+		// the first call fills the cache, the measured ones are hits
+		auto sourcePath = fs::path( sourceStem + ".hdr" );
+		cmft::createPmrem( sourcePath, output, faceSize, options, true );
+		unload( output );
+		runner.run( "cache/load/pmrem/" + to_string( faceSize ), noop, [&]() { cmft::createPmrem( sourcePath, output, faceSize, options, true ); }, unloadAll );
+	}
+
+	unload( latLong );
+	unload( cubemap );
+	fs::remove_all( scratch );
+
+	if( settings.mOutput.empty() ) {
+		runner.writeJson( cout );
+	}
+	else {
+		std::ofstream file( settings.mOutput.string() );
+		runner.writeJson( file );
+		if( ! file ) {
+			cerr << "can't write " << settings.mOutput << endl;
+			return 1;
+		}
+	}
+
+	if( ! settings.mBaseline.empty() && compareToBaseline( runner.getResults(), baseline, settings ) ) {
+		return 3;
+	}
+	return 0;
+}